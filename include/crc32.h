@@ -5,7 +5,48 @@
 #ifndef CRC32_H
 #define CRC32_H
 
+#define CRC32_ENGINES 2
+
+/* Update of the raw crc32 register, no preset or final xor */
+typedef uint32_t ( *crc32_update_t ) ( uint32_t crc, const uint8_t * buf, size_t len );
+
+/* Update function and its name */
+struct crc32_engine_desc
+{
+    crc32_update_t fn;
+    const char *name;
+};
+
 /* Calculate crc32 checksum */
 extern uint32_t crc32buf ( uint8_t * buf, size_t len );
 
+/* Continue crc32 checksum over next block, start from 0xFFFFFFFF */
+extern uint32_t crc32_update ( uint32_t crc, const uint8_t * buf, size_t len );
+
+/* Continue crc32 checksum over n copies of byte b without reading them */
+extern uint32_t crc32_fill ( uint32_t crc, uint8_t b, size_t n );
+
+/* Combine crc32buf results of two adjacent blocks */
+extern uint32_t crc32_combine ( uint32_t crc1, uint32_t crc2, size_t len2 );
+
+/* Carry crc32buf result of a block over bytes changed from old to new, dist before its end */
+extern uint32_t crc32_patch ( uint32_t crc, const uint8_t * old, const uint8_t * new, size_t len,
+    size_t dist );
+
+/* Called by each helper thread of crc32buf_mt_done once its chunk is done */
+typedef void ( *crc32_done_t ) ( void *arg );
+
+/* Calculate crc32 checksum using multiple threads */
+extern uint32_t crc32buf_mt ( uint8_t * buf, size_t len, unsigned int threads );
+
+/* Calculate crc32 checksum using multiple threads, helpers call done before exiting */
+extern uint32_t crc32buf_mt_done ( uint8_t * buf, size_t len, unsigned int threads,
+    crc32_done_t done, void *arg );
+
+/* Get name of the selected crc32 engine */
+extern const char *crc32_engine ( void );
+
+/* List engines supported by this cpu, fastest first, CRC32_ENGINES at most */
+extern unsigned int crc32_engines ( struct crc32_engine_desc engines[] );
+
 #endif
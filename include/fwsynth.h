@@ -0,0 +1,16 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils - Synthetic Image Builder Header
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+#ifndef FWSYNTH_H
+#define FWSYNTH_H
+
+/* Fill buffer with xorshift noise, same for same seed */
+extern void fw_fill ( unsigned char *buf, size_t len, uint64_t seed );
+
+/* Store header skeleton of format in front of payload, checksums left zero */
+extern int fw_skeleton ( const char *format, unsigned char *buf, size_t size );
+
+#endif
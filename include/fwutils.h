@@ -0,0 +1,356 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Shared Project Header
+ * ------------------------------------------------------------------ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "md5.h"
+
+#ifndef FWUTILS_H
+#define FWUTILS_H
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Image access modes */
+#define FW_IMAGE_MAPPED 0       /* whole file mapped into memory */
+#define FW_IMAGE_STREAMED 1     /* file read in chunks */
+
+/* Mapped image access policies */
+#define FW_ADVICE_NONE 0        /* demand faults only */
+#define FW_ADVICE_SEQUENTIAL 1  /* read ahead by window, drop pages behind */
+#define FW_ADVICE_WILLNEED 2    /* read whole file ahead */
+#define FW_ADVICE_POPULATE 3    /* prefault whole file on mmap */
+#define FW_ADVICE_HUGEPAGE 4    /* transparent huge pages, then as sequential */
+#define FW_ADVICE_DEFAULT FW_ADVICE_WILLNEED
+
+#define FW_HEADER_MAX 4096      /* header bytes buffered in streamed mode */
+#define FW_CHUNK_SIZE (1 << 20) /* read size in streamed mode */
+#define FW_ALIGN 4096           /* read buffer and file offset alignment */
+#define FW_WINDOW (8 << 20)     /* mapped walk window for sequential advice */
+#define FW_TO_END ((size_t) -1) /* range length up to end of image */
+
+/* Command line options accepted by a tool */
+#define FW_OPT_UPDATE 1         /* -u */
+#define FW_OPT_THREADS 2        /* -j threads */
+#define FW_OPT_BATCH 4          /* -b, -l list */
+#define FW_OPT_SCAN 8           /* -f */
+#define FW_OPT_FORMAT 16        /* --format */
+#define FW_OPT_INDEX 32         /* --index */
+#define FW_OPT_PATCH 64         /* --patch offset:hexbytes */
+
+/* Result output formats */
+#define FW_OUTPUT_TEXT 0        /* tool specific report */
+#define FW_OUTPUT_JSON 1        /* one object per line */
+#define FW_OUTPUT_CSV 2         /* header row, one row per checksum */
+#define FW_OUTPUT_TSV 3         /* as csv, tab separated */
+
+#define FW_OUTPUT_SIZE (64 << 10)       /* output buffer, written out at once */
+#define FW_CHECKS_MAX 4         /* checksums kept per image */
+#define FW_SUM_MAX 16           /* checksum bytes */
+#define FW_NAME_MAX 16          /* checksum name, terminated */
+
+/* Batch verification results */
+#define FW_RESULT_CORRECT 0
+#define FW_RESULT_INCORRECT 1
+#define FW_RESULT_ERROR 2
+
+/* Timed phases, indexed by FW_PHASE_* */
+#define FW_PHASE_OPEN 0         /* open, map and advise */
+#define FW_PHASE_HASH 1         /* checksum computation */
+#define FW_PHASE_SYNC 2         /* checksum written back */
+#define FW_PHASE_CLOSE 3        /* unmap and close */
+#define FW_PHASES 4
+
+/* Options shared by all tools */
+struct fw_options
+{
+    int readonly;               /* do not update checksums */
+    int batch;                  /* process all files given */
+    int scan;                   /* search file for embedded headers */
+    int stats;                  /* report timing statistics to stderr */
+    int index;                  /* use block crc32 sidecar of each file */
+    int output;                 /* result output format */
+    int mode;                   /* image access mode */
+    int advice;                 /* mapped access policy */
+    unsigned long offset;       /* header offset from file beginning */
+    unsigned int threads;       /* checksum or batch threads, 0 if not given */
+    const char *list;           /* file holding paths to be verified */
+    const char *cache;          /* verification cache file, NULL if none */
+    unsigned char *patch;       /* bytes to be patched in, NULL if none */
+    size_t patch_len;
+    unsigned long patch_off;    /* patch offset from header */
+    char **paths;               /* files to be processed */
+    unsigned int count;         /* number of files */
+};
+
+/* Phase start in the calling thread */
+struct fw_stats_mark
+{
+    int active;                 /* statistics were collected at start */
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    long majflt;
+    long minflt;
+    uint64_t threads_cpu_ns;    /* added by worker threads of the phase */
+    long threads_majflt;
+    long threads_minflt;
+    struct fw_stats_mark *outer;        /* phase open in this thread before */
+};
+
+/* Identity of a verified image in the cache, padding free */
+struct fw_cache_key
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;              /* file size */
+    uint64_t mtime_ns;
+    uint64_t offset;            /* header offset from file beginning */
+    char format[8];             /* format the image was verified as */
+};
+
+/* Block crc32 index of an image, private to fwindex.c */
+struct fw_index;
+
+/* Firmware image handle */
+struct fw_image
+{
+    int fd;                     /* file descriptor */
+    int mode;                   /* image access mode */
+    int advice;                 /* mapped access policy */
+    int readonly;               /* opened without write access */
+    int sequential;             /* pipe, read once front to back */
+    size_t length;              /* file length, FW_TO_END while unknown */
+    size_t offset;              /* header offset from file beginning */
+    unsigned char *pmaddr;      /* whole file mapping, mapped mode only */
+    unsigned char *header;      /* image bytes starting at offset */
+    size_t header_len;          /* image bytes available at header */
+    unsigned char *buffer;      /* read buffers, streamed mode only */
+    unsigned char *chunk[2];    /* double buffered reads */
+    size_t pos;                 /* bytes consumed past header */
+    size_t dirty_start;         /* header bytes modified, from */
+    size_t dirty_end;           /* header bytes modified, to */
+    struct fw_index *index;     /* block crc32 index, NULL if none */
+};
+
+/* Checksum stored in a header next to the one computed */
+struct fw_check
+{
+    char name[FW_NAME_MAX];     /* stable key */
+    unsigned int len;           /* checksum bytes */
+    unsigned char stored[FW_SUM_MAX];
+    unsigned char computed[FW_SUM_MAX];
+};
+
+/* Verification result of one image */
+struct fw_record
+{
+    const char *path;
+    const char *format;
+    unsigned long offset;       /* header offset from file beginning */
+    size_t size;                /* image size, 0 if unknown */
+    int result;                 /* FW_RESULT_* */
+    unsigned int count;         /* checksums recorded */
+    struct fw_check check[FW_CHECKS_MAX];
+};
+
+/* Result output buffer */
+struct fw_output
+{
+    int format;                 /* FW_OUTPUT_* */
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+/* Firmware format handler */
+struct fw_format
+{
+    const char *name;
+    unsigned int group;         /* images verified together by verify_group */
+    int ( *probe ) ( const unsigned char *header, size_t len );
+    size_t ( *extent ) ( const unsigned char *header, size_t len );    /* after probe */
+    int ( *process ) ( struct fw_image * image, const struct fw_options * options );
+    int ( *verify ) ( struct fw_image * image, const struct fw_options * options,
+        struct fw_record * record );
+    void ( *verify_group ) ( char *paths[], unsigned int count,
+        const struct fw_options * options, struct fw_record records[] );
+    int ( *patch ) ( struct fw_image * image, const struct fw_options * options );
+};
+
+/* Image data consumer for fw_image_walk */
+typedef void ( *fw_walk_t ) ( void *arg, const unsigned char *buf, size_t len );
+
+/* Scan candidate consumer, pos is where a magic starts */
+typedef void ( *fw_hit_t ) ( void *arg, size_t pos );
+
+/* Supported firmware formats */
+extern const struct fw_format fw_format_trx;
+extern const struct fw_format fw_format_bcm;
+extern const struct fw_format fw_format_tplink;
+extern const struct fw_format fw_format_binhdr;
+extern const struct fw_format fw_format_auto;
+
+/* Known formats in probing order, NULL terminated */
+extern const struct fw_format *const fw_formats[];
+
+/* Result names, indexed by FW_RESULT_* */
+extern const char *const fw_result_names[];
+
+/* Open firmware image for processing */
+extern int fw_image_open ( struct fw_image *image, const char *path, int readonly, int mode,
+    int advice, unsigned long offset );
+
+/* Release firmware image resources */
+extern void fw_image_close ( struct fw_image *image );
+
+/* Get image size starting at header, FW_TO_END while stream is not consumed */
+extern size_t fw_image_size ( const struct fw_image *image );
+
+/* Pass image range to consumer, offsets are relative to header */
+extern int fw_image_walk ( struct fw_image *image, size_t off, size_t len, fw_walk_t fn,
+    void *arg );
+
+/* Calculate crc32 checksum of image range */
+extern int fw_image_crc32 ( struct fw_image *image, size_t off, size_t len, uint32_t * crc );
+
+/* Calculate crc32 checksum of image range using multiple threads */
+extern int fw_image_crc32_mt ( struct fw_image *image, size_t off, size_t len,
+    unsigned int threads, uint32_t * crc );
+
+/* Feed image range into md5 context */
+extern int fw_image_md5 ( struct fw_image *image, size_t off, size_t len, MD5_CTX * ctx );
+
+/* Record modified header bytes */
+extern void fw_image_dirty ( struct fw_image *image, size_t off, size_t len );
+
+/* Write bytes over image range, durably, previous ones are kept in old */
+extern int fw_image_patch ( struct fw_image *image, size_t off, const unsigned char *buf,
+    size_t len, unsigned char *old );
+
+/* Write modified header bytes back to file */
+extern int fw_image_sync ( struct fw_image *image );
+
+/* Narrow mapped image to an embedded image, the view is not to be closed */
+extern void fw_image_view ( const struct fw_image *image, size_t off, size_t len,
+    struct fw_image *view );
+
+/* Get mapped access policy by name, -1 if unknown */
+extern int fw_advice_parse ( const char *name );
+
+/* Find format of image header, NULL if unknown */
+extern const struct fw_format *fw_format_detect ( const struct fw_image *image );
+
+/* Prepare record of a file to be verified */
+extern void fw_record_init ( struct fw_record *record, const struct fw_format *format,
+    const struct fw_options *options, const char *path );
+
+/* Record crc32 stored in a header and the one computed */
+extern void fw_record_crc32 ( struct fw_record *record, const char *name, uint32_t stored,
+    uint32_t computed );
+
+/* Record md5 stored in a header and the one computed */
+extern void fw_record_md5 ( struct fw_record *record, const char *name,
+    const unsigned char *stored, const unsigned char *computed );
+
+/* Get output format by name, -1 if unknown */
+extern int fw_output_parse ( const char *name );
+
+/* Allocate output buffer, csv and tsv start with a header row */
+extern int fw_output_init ( struct fw_output *output, int format );
+
+/* Append serialized record, flush first if it might not fit */
+extern int fw_output_record ( struct fw_output *output, const struct fw_record *record );
+
+/* Write buffered output out at once */
+extern int fw_output_flush ( struct fw_output *output );
+
+/* Flush and release output buffer */
+extern int fw_output_free ( struct fw_output *output );
+
+/* Get name of the selected scan engine */
+extern const char *fw_scan_engine ( void );
+
+/* Report every position in buffer where a known magic starts */
+extern void fw_scan_magic ( const unsigned char *buf, size_t len, fw_hit_t fn, void *arg );
+
+/* Search files for embedded headers, verify and report each one found */
+extern int fw_scan ( const struct fw_format *format, const struct fw_options *options );
+
+/* Start collecting statistics */
+extern void fw_stats_start ( void );
+
+/* Mark start of a phase in the calling thread, no-op unless collecting */
+extern void fw_stats_begin ( struct fw_stats_mark *mark );
+
+/* Account phase begun at mark to its totals */
+extern void fw_stats_end ( const struct fw_stats_mark *mark, int phase, uint64_t bytes );
+
+/* Get phase open in the calling thread, to be handed to its worker threads */
+extern struct fw_stats_mark *fw_stats_current ( void );
+
+/* Add cpu time and faults of the calling worker thread so far to phase at mark */
+extern void fw_stats_thread ( struct fw_stats_mark *mark );
+
+/* Print statistics to stderr in output format, stop collecting */
+extern void fw_stats_report ( int output, int scan );
+
+/* Open cache file and map it, -1 if it cannot be used */
+extern int fw_cache_open ( const char *path );
+
+/* Unmap and close cache file */
+extern void fw_cache_close ( void );
+
+/* Look image up, 1 if record was answered from cache, 0 if not, -1 if not cacheable */
+extern int fw_cache_lookup ( struct fw_cache_key *key, const struct fw_format *format,
+    unsigned long offset, const char *path, struct fw_record *record );
+
+/* Keep verified record under key looked up before */
+extern void fw_cache_store ( const struct fw_cache_key *key, const struct fw_record *record );
+
+/* Attach block index of image file, loaded from its sidecar when still valid */
+extern int fw_index_open ( struct fw_image *image, const char *path );
+
+/* Detach block index, its sidecar is written if it was rebuilt */
+extern void fw_index_close ( struct fw_image *image );
+
+/* Combine crc32 checksum of image range from blocks, hashed bytes are added up */
+extern int fw_index_crc32 ( struct fw_image *image, size_t off, size_t len,
+    unsigned int threads, uint32_t * crc, size_t *hashed );
+
+/* Rehash blocks holding header bytes just written and synced */
+extern void fw_index_dirty ( struct fw_image *image, size_t off, size_t len );
+
+/* Feed image from off to end into md5 context, resuming the last unchanged checkpoint */
+extern int fw_index_md5 ( struct fw_image *image, size_t off, MD5_CTX * ctx, size_t *hashed );
+
+/* Parse command line options */
+extern int fw_parse_args ( int argc, char *argv[], int allowed, struct fw_options *options );
+
+/* Verify files on a work stealing thread pool, print results in order */
+extern int fw_batch ( const struct fw_format *format, const struct fw_options *options );
+
+/* Verify one file into record */
+extern void fw_verify ( const struct fw_format *format, const struct fw_options *options,
+    const char *path, struct fw_record *record );
+
+/* Process files with format handler */
+extern int fw_run ( const struct fw_format *format, const struct fw_options *options );
+
+#endif
@@ -39,6 +39,8 @@
 
 #ifndef __MD5_INCLUDE__
 
+#include <stddef.h>
+
 /* typedef a 32-bit type */
 #ifdef _LP64
 typedef unsigned int UINT4;
@@ -58,9 +60,58 @@ typedef struct
     unsigned char digest[16];   /* actual digest after MD5Final call */
 } MD5_CTX;
 
-void MD5_Init (  );
-void MD5_Update (  );
-void MD5_Final (  );
+/* Midstate of MD5 computation, taken on a block boundary */
+typedef struct
+{
+    UINT4 i[2];                 /* number of _bits_ handled mod 2^64 */
+    UINT4 buf[4];               /* chaining state */
+} MD5_STATE;
+
+#define MD5_STATE_SIZE 24       /* serialized midstate, little-endian words */
+
+/* Block function, transforms nblocks 64-byte blocks of data into buf */
+typedef void ( *MD5_BLOCKS ) ( UINT4 * buf, const unsigned char *data, size_t nblocks );
+
+/* Block function and its name */
+typedef struct
+{
+    MD5_BLOCKS fn;
+    const char *name;
+} MD5_ENGINE;
+
+/* Lane kernel, hashes nblocks blocks of each data[] into state[] */
+typedef void ( *MD5_MULTI_KERNEL ) ( UINT4 * state[], const unsigned char *data[],
+    size_t nblocks );
+
+/* Lane kernel, its width and name */
+typedef struct
+{
+    MD5_MULTI_KERNEL fn;
+    unsigned int lanes;
+    const char *name;
+} MD5_MULTI_ENGINE;
+
+#define MD5_MULTI_ENGINES 2
+
+void MD5_Init ( MD5_CTX * mdContext );
+void MD5_Update ( MD5_CTX * mdContext, const void *inBuf, size_t inLen );
+void MD5_Final ( unsigned char hash[], MD5_CTX * mdContext );
+int MD5_Save ( const MD5_CTX * mdContext, MD5_STATE * state );
+void MD5_Restore ( MD5_CTX * mdContext, const MD5_STATE * state );
+void MD5_Serialize ( const MD5_STATE * state, unsigned char out[] );
+void MD5_Deserialize ( MD5_STATE * state, const unsigned char in[] );
+int MD5_SelfTest ( void );
+const char *MD5_Engine ( void );
+unsigned int MD5_Engines ( const MD5_ENGINE ** engines );
+void MD5_Update_Engine ( const MD5_ENGINE * engine, MD5_CTX * mdContext, const void *inBuf,
+    size_t inLen );
+void MD5_Final_Engine ( const MD5_ENGINE * engine, unsigned char hash[], MD5_CTX * mdContext );
+void MD5_Update_Multi ( MD5_CTX * mdContext[], const void *inBuf[], const size_t inLen[],
+    unsigned int count );
+const char *MD5_Multi_Engine ( void );
+unsigned int MD5_Multi_Engines ( MD5_MULTI_ENGINE engines[] );
+void MD5_Update_Multi_Engine ( const MD5_MULTI_ENGINE * engine, MD5_CTX * mdContext[],
+    const void *inBuf[], const size_t inLen[], unsigned int count );
 
 #define __MD5_INCLUDE__
 #endif /* __MD5_INCLUDE__ */
@@ -60,8 +60,19 @@
 /*     hardware you could probably optimize the shift in assembler by  */
 /*     using byte-swap instructions.                                   */
 
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "trxcrc32.h"
 
+#define CRC32_MAX_THREADS 256
+#define CRC32_MIN_CHUNK 65536
+#define CRC32_RUN_CHUNK 4096
+#define CRC32_RUN_MIN 65536     /* shorter runs hash faster than they fast-forward */
+
 static const uint32_t crc_32_tab[] = {  /* CRC polynomial 0xedb88320 */
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
     0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
@@ -110,14 +121,611 @@ static const uint32_t crc_32_tab[] = {  /* CRC polynomial 0xedb88320 */
 
 #define UPDC32(octet,crc) (crc_32_tab[((crc) ^ (octet)) & 0xff] ^ ((crc) >> 8))
 
-uint32_t crc32buf ( uint8_t * buf, size_t len )
+/* Slicing-by-N is selected at build time, 1 keeps the byte loop only */
+#ifndef CRC32_SLICE
+#define CRC32_SLICE 1
+#endif
+
+#if CRC32_SLICE != 1 && CRC32_SLICE != 4 && CRC32_SLICE != 8 && CRC32_SLICE != 16
+#error "CRC32_SLICE must be 1, 4, 8 or 16"
+#endif
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+#if CRC32_SLICE > 1
+
+/* Tables are produced by crc32gen when building */
+#include "crc32tab.h"
+
+#if CRC32_TAB_SLICES < CRC32_SLICE
+#error "crc32tab.h was generated with too few slices"
+#endif
+
+#define T crc_32_slice_tab
+
+/* Load little-endian 32-bit word, folds into a single load on LE hosts */
+#define LOADLE32(p) \
+    ((uint32_t) (p)[0] | ((uint32_t) (p)[1] << 8) | \
+    ((uint32_t) (p)[2] << 16) | ((uint32_t) (p)[3] << 24))
+
+/* Fold one 32-bit word into the crc using tables base..base+3 */
+#define SLICE32(w, base) \
+    (T[(base) + 3][(w) & 0xff] ^ T[(base) + 2][((w) >> 8) & 0xff] ^ \
+    T[(base) + 1][((w) >> 16) & 0xff] ^ T[(base)][(w) >> 24])
+
+/* Update crc32 register with slicing-by-N tables */
+static uint32_t crc32_update_slice ( uint32_t crc, const uint8_t * buf, size_t len )
 {
-    uint32_t crc = 0xFFFFFFFF;
+    uint32_t w0;
+#if CRC32_SLICE >= 8
+    uint32_t w1;
+#endif
+#if CRC32_SLICE >= 16
+    uint32_t w2;
+    uint32_t w3;
+#endif
+
+    for ( ; len >= CRC32_SLICE; len -= CRC32_SLICE, buf += CRC32_SLICE )
+    {
+        w0 = LOADLE32 ( buf ) ^ crc;
+#if CRC32_SLICE == 4
+        crc = SLICE32 ( w0, 0 );
+#elif CRC32_SLICE == 8
+        w1 = LOADLE32 ( buf + 4 );
+        crc = SLICE32 ( w0, 4 ) ^ SLICE32 ( w1, 0 );
+#else
+        w1 = LOADLE32 ( buf + 4 );
+        w2 = LOADLE32 ( buf + 8 );
+        w3 = LOADLE32 ( buf + 12 );
+        crc = SLICE32 ( w0, 12 ) ^ SLICE32 ( w1, 8 ) ^ SLICE32 ( w2, 4 ) ^ SLICE32 ( w3, 0 );
+#endif
+    }
+
+    for ( ; len; --len, ++buf )
+    {
+        crc = UPDC32 ( *buf, crc );
+    }
+
+    return crc;
+}
+
+#undef T
+
+#endif
 
+/* Update crc32 register with the portable table-driven engine */
+static uint32_t crc32_update_table ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+#if CRC32_SLICE > 1
+    return crc32_update_slice ( crc, buf, len );
+#else
     for ( ; len; --len, ++buf )
     {
         crc = UPDC32 ( *buf, crc );
     }
 
+    return crc;
+#endif
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+/*
+ * Carry-less multiply folding after Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction". Four 128-bit lanes
+ * are folded 64 bytes at a time, reduced to one lane, then Barrett
+ * reduced to 32 bits. Constants are for the bit-reflected 0xedb88320.
+ */
+__attribute__ ( ( target ( "pclmul,sse2" ) ) )
+static uint32_t crc32_update_pclmul ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+    static const uint64_t k1k2[2] __attribute__ ( ( aligned ( 16 ) ) ) = {
+        0x0154442bd4, 0x01c6e41596
+    };
+    static const uint64_t k3k4[2] __attribute__ ( ( aligned ( 16 ) ) ) = {
+        0x01751997d0, 0x00ccaa009e
+    };
+    static const uint64_t k5k0[2] __attribute__ ( ( aligned ( 16 ) ) ) = {
+        0x0163cd6124, 0x0000000000
+    };
+    static const uint64_t poly[2] __attribute__ ( ( aligned ( 16 ) ) ) = {
+        0x01db710641, 0x01f7011641
+    };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    if ( len < 64 )
+    {
+        return crc32_update_table ( crc, buf, len );
+    }
+
+    x1 = _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x00 ) );
+    x2 = _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x10 ) );
+    x3 = _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x20 ) );
+    x4 = _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x30 ) );
+    x1 = _mm_xor_si128 ( x1, _mm_cvtsi32_si128 ( ( int ) crc ) );
+    x0 = _mm_load_si128 ( ( const __m128i * ) k1k2 );
+    buf += 64;
+    len -= 64;
+
+    /* fold four lanes in parallel */
+    for ( ; len >= 64; buf += 64, len -= 64 )
+    {
+        x5 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+        x6 = _mm_clmulepi64_si128 ( x2, x0, 0x00 );
+        x7 = _mm_clmulepi64_si128 ( x3, x0, 0x00 );
+        x8 = _mm_clmulepi64_si128 ( x4, x0, 0x00 );
+        x1 = _mm_clmulepi64_si128 ( x1, x0, 0x11 );
+        x2 = _mm_clmulepi64_si128 ( x2, x0, 0x11 );
+        x3 = _mm_clmulepi64_si128 ( x3, x0, 0x11 );
+        x4 = _mm_clmulepi64_si128 ( x4, x0, 0x11 );
+        x1 = _mm_xor_si128 ( _mm_xor_si128 ( x1, x5 ),
+            _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x00 ) ) );
+        x2 = _mm_xor_si128 ( _mm_xor_si128 ( x2, x6 ),
+            _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x10 ) ) );
+        x3 = _mm_xor_si128 ( _mm_xor_si128 ( x3, x7 ),
+            _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x20 ) ) );
+        x4 = _mm_xor_si128 ( _mm_xor_si128 ( x4, x8 ),
+            _mm_loadu_si128 ( ( const __m128i * ) ( buf + 0x30 ) ) );
+    }
+
+    /* fold four lanes into one */
+    x0 = _mm_load_si128 ( ( const __m128i * ) k3k4 );
+    x5 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128 ( x1, x0, 0x11 );
+    x1 = _mm_xor_si128 ( _mm_xor_si128 ( x1, x2 ), x5 );
+    x5 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128 ( x1, x0, 0x11 );
+    x1 = _mm_xor_si128 ( _mm_xor_si128 ( x1, x3 ), x5 );
+    x5 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128 ( x1, x0, 0x11 );
+    x1 = _mm_xor_si128 ( _mm_xor_si128 ( x1, x4 ), x5 );
+
+    /* fold remaining 16-byte blocks */
+    for ( ; len >= 16; buf += 16, len -= 16 )
+    {
+        x5 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+        x1 = _mm_clmulepi64_si128 ( x1, x0, 0x11 );
+        x1 = _mm_xor_si128 ( _mm_xor_si128 ( x1, x5 ),
+            _mm_loadu_si128 ( ( const __m128i * ) buf ) );
+    }
+
+    /* fold 128 bits down to 64 bits */
+    x2 = _mm_clmulepi64_si128 ( x1, x0, 0x10 );
+    x3 = _mm_setr_epi32 ( ~0, 0, ~0, 0 );
+    x1 = _mm_srli_si128 ( x1, 8 );
+    x1 = _mm_xor_si128 ( x1, x2 );
+    x0 = _mm_loadl_epi64 ( ( const __m128i * ) k5k0 );
+    x2 = _mm_srli_si128 ( x1, 4 );
+    x1 = _mm_and_si128 ( x1, x3 );
+    x1 = _mm_clmulepi64_si128 ( x1, x0, 0x00 );
+    x1 = _mm_xor_si128 ( x1, x2 );
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128 ( ( const __m128i * ) poly );
+    x2 = _mm_and_si128 ( x1, x3 );
+    x2 = _mm_clmulepi64_si128 ( x2, x0, 0x10 );
+    x2 = _mm_and_si128 ( x2, x3 );
+    x2 = _mm_clmulepi64_si128 ( x2, x0, 0x00 );
+    x1 = _mm_xor_si128 ( x1, x2 );
+    crc = ( uint32_t ) _mm_cvtsi128_si32 ( _mm_srli_si128 ( x1, 4 ) );
+
+    /* leftover bytes go through the tables */
+    return crc32_update_table ( crc, buf, len );
+}
+
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+
+#include <arm_acle.h>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+
+/* Update crc32 register with ARMv8 CRC32 instructions */
+__attribute__ ( ( target ( "+crc" ) ) )
+static uint32_t crc32_update_armv8 ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+    uint64_t word;
+
+    for ( ; len && ( ( uintptr_t ) buf & 7 ); --len, ++buf )
+    {
+        crc = __crc32b ( crc, *buf );
+    }
+
+    for ( ; len >= 8; len -= 8, buf += 8 )
+    {
+        memcpy ( &word, buf, sizeof ( word ) );
+        crc = __crc32d ( crc, word );
+    }
+
+    for ( ; len; --len, ++buf )
+    {
+        crc = __crc32b ( crc, *buf );
+    }
+
+    return crc;
+}
+
+#endif
+
+static crc32_update_t crc32_update_fn;
+static const char *crc32_engine_name;
+static uint32_t crc32_x2n_tab[32];
+static pthread_once_t crc32_engine_once = PTHREAD_ONCE_INIT;
+
+/* Multiply a(x) by b(x) modulo the crc32 polynomial, bit-reflected */
+static uint32_t crc32_multmodp ( uint32_t a, uint32_t b )
+{
+    uint32_t m = ( uint32_t ) 1 << 31;
+    uint32_t p = 0;
+
+    for ( ;; )
+    {
+        if ( a & m )
+        {
+            p ^= b;
+            if ( !( a & ( m - 1 ) ) )
+            {
+                break;
+            }
+        }
+        m >>= 1;
+        b = ( b & 1 ) ? ( b >> 1 ) ^ 0xedb88320 : b >> 1;
+    }
+
+    return p;
+}
+
+/* Get x^(n * 2^k) modulo the crc32 polynomial */
+static uint32_t crc32_x2nmodp ( uint64_t n, unsigned int k )
+{
+    uint32_t p = ( uint32_t ) 1 << 31;
+
+    for ( ; n; n >>= 1, k++ )
+    {
+        if ( n & 1 )
+        {
+            p = crc32_multmodp ( crc32_x2n_tab[k & 31], p );
+        }
+    }
+
+    return p;
+}
+
+/* Continue crc32 register over n copies of byte b, O(log n) */
+static uint32_t crc32_fill_reg ( uint32_t crc, uint8_t b, uint64_t n )
+{
+    unsigned int k;
+    uint64_t left;
+    uint32_t pow = crc_32_tab[b];
+    uint32_t run = 0;
+
+    /* pow holds 2^k copies hashed from zero, doubled by shifting past itself */
+    for ( k = 0, left = n; b && left; left >>= 1, k++ )
+    {
+        if ( left & 1 )
+        {
+            run = crc32_multmodp ( crc32_x2n_tab[( k + 3 ) & 31], run ) ^ pow;
+        }
+        pow = crc32_multmodp ( crc32_x2n_tab[( k + 3 ) & 31], pow ) ^ pow;
+    }
+
+    return crc32_multmodp ( crc32_x2nmodp ( n, 3 ), crc ) ^ run;
+}
+
+/* Check block of len, a multiple of 64, holds byte b only */
+static int crc32_is_run ( const uint8_t * buf, size_t len, uint8_t b )
+{
+    size_t i;
+#if defined(__SSE2__)
+    __m128i fill = _mm_set1_epi8 ( ( char ) b );
+    __m128i eq;
+
+    for ( i = 0; i < len; i += 64 )
+    {
+        eq = _mm_cmpeq_epi8 ( _mm_loadu_si128 ( ( const __m128i * ) ( buf + i ) ), fill );
+        eq = _mm_and_si128 ( eq, _mm_cmpeq_epi8 ( _mm_loadu_si128 ( ( const __m128i * ) ( buf
+                        + i + 16 ) ), fill ) );
+        eq = _mm_and_si128 ( eq, _mm_cmpeq_epi8 ( _mm_loadu_si128 ( ( const __m128i * ) ( buf
+                        + i + 32 ) ), fill ) );
+        eq = _mm_and_si128 ( eq, _mm_cmpeq_epi8 ( _mm_loadu_si128 ( ( const __m128i * ) ( buf
+                        + i + 48 ) ), fill ) );
+        if ( _mm_movemask_epi8 ( eq ) != 0xFFFF )
+        {
+            return 0;
+        }
+    }
+#else
+    unsigned int j;
+    uint64_t fill = b * 0x0101010101010101ULL;
+    uint64_t diff;
+    uint64_t w[8];
+
+    for ( i = 0; i < len; i += 64 )
+    {
+        memcpy ( w, buf + i, sizeof ( w ) );
+        for ( diff = 0, j = 0; j < 8; j++ )
+        {
+            diff |= w[j] ^ fill;
+        }
+        if ( diff )
+        {
+            return 0;
+        }
+    }
+#endif
+
+    return 1;
+}
+
+/* Update crc32 register, long runs of one byte are fast-forwarded */
+static uint32_t crc32_update_runs ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+    const uint8_t *end = buf + len;
+    const uint8_t *data = buf;
+    const uint8_t *p = buf;
+    const uint8_t *q;
+
+    while ( ( size_t ) ( end - p ) >= CRC32_RUN_CHUNK )
+    {
+        /* differing ends rule most chunks out before the scan */
+        if ( p[0] != p[CRC32_RUN_CHUNK - 1] || !crc32_is_run ( p, CRC32_RUN_CHUNK, p[0] ) )
+        {
+            p += CRC32_RUN_CHUNK;
+            continue;
+        }
+
+        for ( q = p + CRC32_RUN_CHUNK; ( size_t ) ( end - q ) >= CRC32_RUN_CHUNK
+            && crc32_is_run ( q, CRC32_RUN_CHUNK, p[0] ); q += CRC32_RUN_CHUNK )
+        {
+        }
+
+        if ( q - p >= CRC32_RUN_MIN )
+        {
+            crc = crc32_update_fn ( crc, data, p - data );
+            crc = crc32_fill_reg ( crc, p[0], q - p );
+            data = q;
+        }
+
+        p = q;
+    }
+
+    return crc32_update_fn ( crc, data, end - data );
+}
+
+/* List engines supported by this cpu, fastest first */
+unsigned int crc32_engines ( struct crc32_engine_desc engines[] )
+{
+    unsigned int count = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( __get_cpuid ( 1, &eax, &ebx, &ecx, &edx ) && ( ecx & bit_PCLMUL ) )
+    {
+        engines[count].fn = crc32_update_pclmul;
+        engines[count++].name = "pclmul";
+    }
+#elif defined(__aarch64__) && defined(__GNUC__)
+    if ( getauxval ( AT_HWCAP ) & HWCAP_CRC32 )
+    {
+        engines[count].fn = crc32_update_armv8;
+        engines[count++].name = "armv8-crc";
+    }
+#endif
+
+    engines[count].fn = crc32_update_table;
+    engines[count++].name = CRC32_SLICE > 1 ? "slice-by-" STR ( CRC32_SLICE ) : "table";
+
+    return count;
+}
+
+/* Pick the fastest crc32 engine supported by this cpu */
+static void crc32_engine_setup ( void )
+{
+    unsigned int n;
+    struct crc32_engine_desc engines[CRC32_ENGINES];
+
+    crc32_engines ( engines );
+
+    /* x^(2^n) operators for crc32_combine */
+    crc32_x2n_tab[0] = ( uint32_t ) 1 << 30;
+    for ( n = 1; n < 32; n++ )
+    {
+        crc32_x2n_tab[n] = crc32_multmodp ( crc32_x2n_tab[n - 1], crc32_x2n_tab[n - 1] );
+    }
+
+    crc32_engine_name = engines[0].name;
+    crc32_update_fn = engines[0].fn;
+}
+
+/* Set engine up once, callers on other threads wait until it is done */
+static void crc32_engine_init ( void )
+{
+    pthread_once ( &crc32_engine_once, crc32_engine_setup );
+}
+
+/* Get name of the selected crc32 engine */
+const char *crc32_engine ( void )
+{
+    crc32_engine_init (  );
+
+    return crc32_engine_name;
+}
+
+uint32_t crc32buf ( uint8_t * buf, size_t len )
+{
+    crc32_engine_init (  );
+
+    return crc32_update_runs ( 0xFFFFFFFF, buf, len );
+}
+
+/* Continue crc32 checksum over next block */
+uint32_t crc32_update ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+    crc32_engine_init (  );
+
+    return crc32_update_runs ( crc, buf, len );
+}
+
+/* Continue crc32 checksum over n copies of byte b without reading them */
+uint32_t crc32_fill ( uint32_t crc, uint8_t b, size_t n )
+{
+    crc32_engine_init (  );
+
+    return crc32_fill_reg ( crc, b, n );
+}
+
+/* Combine crc32buf results of two adjacent blocks */
+uint32_t crc32_combine ( uint32_t crc1, uint32_t crc2, size_t len2 )
+{
+    crc32_engine_init (  );
+
+    /* shift the first block past the second, cancelling its preset */
+    return crc32_multmodp ( crc32_x2nmodp ( len2, 3 ), crc1 ^ 0xFFFFFFFF ) ^ crc2;
+}
+
+/* Carry crc32buf result of a block over bytes changed from old to new, dist before its end */
+uint32_t crc32_patch ( uint32_t crc, const uint8_t * old, const uint8_t * new, size_t len,
+    size_t dist )
+{
+    size_t i;
+    size_t n;
+    uint32_t delta = 0;
+    uint8_t diff[256];
+
+    crc32_engine_init (  );
+
+    /* crc32 is linear, the xor of both contents moves the checksum alone */
+    for ( ; len; len -= n, old += n, new += n )
+    {
+        n = len < sizeof ( diff ) ? len : sizeof ( diff );
+        for ( i = 0; i < n; i++ )
+        {
+            diff[i] = old[i] ^ new[i];
+        }
+        delta = crc32_update_fn ( delta, diff, n );
+    }
+
+    /* zeros past the change only shift it, x^(8 * dist) mod p */
+    return crc ^ crc32_multmodp ( crc32_x2nmodp ( dist, 3 ), delta );
+}
+
+/* Parallel crc32 job description */
+struct crc32_job
+{
+    pthread_t thread;
+    uint8_t *buf;
+    size_t len;
+    uint32_t crc;
+    crc32_done_t done;
+    void *arg;
+};
+
+/* Parallel crc32 worker routine */
+static void *crc32_job_run ( void *arg )
+{
+    struct crc32_job *job = ( struct crc32_job * ) arg;
+
+    job->crc = crc32_update_runs ( 0xFFFFFFFF, job->buf, job->len );
+
+    return NULL;
+}
+
+/* Parallel crc32 helper thread */
+static void *crc32_job_thread ( void *arg )
+{
+    struct crc32_job *job = ( struct crc32_job * ) arg;
+
+    crc32_job_run ( job );
+    if ( job->done )
+    {
+        job->done ( job->arg );
+    }
+
+    return NULL;
+}
+
+/* Calculate crc32 checksum using multiple threads */
+uint32_t crc32buf_mt ( uint8_t * buf, size_t len, unsigned int threads )
+{
+    return crc32buf_mt_done ( buf, len, threads, NULL, NULL );
+}
+
+/* Calculate crc32 checksum using multiple threads, helpers call done before exiting */
+uint32_t crc32buf_mt_done ( uint8_t * buf, size_t len, unsigned int threads,
+    crc32_done_t done, void *arg )
+{
+    unsigned int i;
+    unsigned int started;
+    size_t chunk;
+    uint32_t crc;
+    struct crc32_job jobs[CRC32_MAX_THREADS];
+
+    crc32_engine_init (  );
+
+    if ( threads > CRC32_MAX_THREADS )
+    {
+        threads = CRC32_MAX_THREADS;
+    }
+
+    /* not worth the thread setup below a few pages each */
+    if ( threads > len / CRC32_MIN_CHUNK )
+    {
+        threads = len / CRC32_MIN_CHUNK;
+    }
+
+    if ( threads <= 1 )
+    {
+        return crc32_update_runs ( 0xFFFFFFFF, buf, len );
+    }
+
+    /* page aligned chunks, the last one takes the remainder */
+    chunk = ( len / threads + 4095 ) & ~( size_t ) 4095;
+    threads = ( len + chunk - 1 ) / chunk;
+
+    for ( i = 0; i < threads; i++ )
+    {
+        jobs[i].buf = buf + i * chunk;
+        jobs[i].len = i + 1 < threads ? chunk : len - i * chunk;
+        jobs[i].done = done;
+        jobs[i].arg = arg;
+    }
+
+    /* current thread handles the first chunk */
+    for ( started = 1; started < threads; started++ )
+    {
+        if ( pthread_create ( &jobs[started].thread, NULL, crc32_job_thread, &jobs[started] ) )
+        {
+            break;
+        }
+    }
+
+    crc32_job_run ( &jobs[0] );
+
+    /* chunks whose thread could not be started are done here */
+    for ( i = started; i < threads; i++ )
+    {
+        crc32_job_run ( &jobs[i] );
+    }
+
+    crc = jobs[0].crc;
+
+    for ( i = 1; i < threads; i++ )
+    {
+        if ( i < started )
+        {
+            pthread_join ( jobs[i].thread, NULL );
+        }
+        crc = crc32_combine ( crc, jobs[i].crc, jobs[i].len );
+    }
+
     return crc;
 }
@@ -0,0 +1,85 @@
+/* ------------------------------------------------------------------
+ * Crc32 Table Generator - Main Program File
+ * ------------------------------------------------------------------ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CRC32_POLY 0xedb88320
+#define CRC32_MAX_SLICES 16
+
+static uint32_t tab[CRC32_MAX_SLICES][256];
+
+/* Show program usage message */
+static void show_usage ( void )
+{
+    fprintf ( stderr, "usage: crc32gen slices\n\n"
+        "  slices      number of tables to generate (1, 4, 8 or 16)\n" "\n" );
+}
+
+/* Program main function */
+int main ( int argc, char *argv[] )
+{
+    unsigned int slices;
+    unsigned int i;
+    unsigned int j;
+    uint32_t crc;
+
+    /* validate arguments count */
+    if ( argc < 2 )
+    {
+        show_usage (  );
+        return 1;
+    }
+
+    /* parse slices count */
+    if ( sscanf ( argv[1], "%u", &slices ) <= 0
+        || ( slices != 1 && slices != 4 && slices != 8 && slices != 16 ) )
+    {
+        show_usage (  );
+        return 1;
+    }
+
+    /* table #0 holds the classic byte-at-a-time feedback terms */
+    for ( i = 0; i < 256; i++ )
+    {
+        crc = i;
+        for ( j = 0; j < 8; j++ )
+        {
+            crc = ( crc & 1 ) ? ( crc >> 1 ) ^ CRC32_POLY : crc >> 1;
+        }
+        tab[0][i] = crc;
+    }
+
+    /* table #k advances table #k-1 entries by one more zero byte */
+    for ( j = 1; j < slices; j++ )
+    {
+        for ( i = 0; i < 256; i++ )
+        {
+            tab[j][i] = ( tab[j - 1][i] >> 8 ) ^ tab[0][tab[j - 1][i] & 0xff];
+        }
+    }
+
+    printf ( "/* ------------------------------------------------------------------\n"
+        " * Crc32 Slicing Tables - Generated by crc32gen, do not edit\n"
+        " * ------------------------------------------------------------------ */\n\n"
+        "#ifndef CRC32TAB_H\n#define CRC32TAB_H\n\n"
+        "#define CRC32_TAB_SLICES %u\n\n"
+        "static const uint32_t crc_32_slice_tab[%u][256] = {\n", slices, slices );
+
+    for ( j = 0; j < slices; j++ )
+    {
+        printf ( "    {\n" );
+        for ( i = 0; i < 256; i++ )
+        {
+            printf ( "%s0x%.8x%s", i % 6 ? " " : "        ", tab[j][i],
+                i == 255 ? "\n" : i % 6 == 5 ? ",\n" : "," );
+        }
+        printf ( "    }%s\n", j + 1 < slices ? "," : "" );
+    }
+
+    printf ( "};\n\n#endif\n" );
+
+    return 0;
+}
@@ -0,0 +1,522 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Batch Verification
+ * ------------------------------------------------------------------ */
+
+#include <dirent.h>
+
+#include "fwutils.h"
+
+#define FW_BATCH_MAX_THREADS 256
+
+/* Growing list of paths to be verified */
+struct fw_paths
+{
+    char **path;
+    unsigned int count;
+    unsigned int size;
+};
+
+/* Task range owned by a worker, thieves take from its tail */
+struct fw_deque
+{
+    pthread_mutex_t lock;
+    unsigned int head;
+    unsigned int tail;
+};
+
+/* State shared by all batch workers */
+struct fw_pool
+{
+    const struct fw_format *format;
+    const struct fw_options *options;
+    struct fw_paths *paths;
+    struct fw_record **records; /* results of each task, released once printed */
+    unsigned char *done;        /* task finished, results may be printed */
+    unsigned int tasks;
+    unsigned int next;          /* next task to be printed */
+    unsigned int threads;
+    unsigned int errors;        /* images that could not be verified */
+    struct fw_output output;
+    pthread_mutex_t print_lock;
+    struct fw_deque deque[FW_BATCH_MAX_THREADS];
+};
+
+/* Batch worker thread argument */
+struct fw_worker
+{
+    struct fw_pool *pool;
+    unsigned int id;
+};
+
+/* Append copy of path to the list */
+static int fw_paths_add ( struct fw_paths *paths, const char *path )
+{
+    char **grown;
+
+    if ( paths->count == paths->size )
+    {
+        paths->size = paths->size ? 2 * paths->size : 256;
+        if ( !( grown = ( char ** ) realloc ( paths->path, paths->size * sizeof ( char * ) ) ) )
+        {
+            fprintf ( stderr, "Error: out of memory\n" );
+            return -1;
+        }
+        paths->path = grown;
+    }
+
+    if ( !( paths->path[paths->count] = strdup ( path ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    paths->count++;
+    return 0;
+}
+
+/* Append regular files below directory, sorted by name */
+static int fw_paths_add_dir ( struct fw_paths *paths, const char *dir )
+{
+    int i;
+    int n;
+    int status = 0;
+    char *path;
+    size_t len;
+    struct stat st;
+    struct dirent **entries;
+
+    if ( ( n = scandir ( dir, &entries, NULL, alphasort ) ) < 0 )
+    {
+        perror ( dir );
+        return -1;
+    }
+
+    for ( i = 0; i < n; i++ )
+    {
+        if ( !status && strcmp ( entries[i]->d_name, "." ) && strcmp ( entries[i]->d_name, ".." ) )
+        {
+            len = strlen ( dir ) + strlen ( entries[i]->d_name ) + 2;
+            if ( !( path = ( char * ) malloc ( len ) ) )
+            {
+                fprintf ( stderr, "Error: out of memory\n" );
+                status = -1;
+
+            } else
+            {
+                snprintf ( path, len, "%s/%s", dir, entries[i]->d_name );
+
+                /* symbolic links to directories are not followed */
+                if ( lstat ( path, &st ) < 0 )
+                {
+                    perror ( path );
+
+                } else if ( S_ISDIR ( st.st_mode ) )
+                {
+                    status = fw_paths_add_dir ( paths, path );
+
+                } else if ( S_ISREG ( st.st_mode )
+                    || ( S_ISLNK ( st.st_mode ) && !stat ( path, &st ) && S_ISREG ( st.st_mode ) ) )
+                {
+                    status = fw_paths_add ( paths, path );
+                }
+
+                free ( path );
+            }
+        }
+
+        free ( entries[i] );
+    }
+
+    free ( entries );
+    return status;
+}
+
+/* Append paths listed one per line in a file, - for stdin */
+static int fw_paths_add_list ( struct fw_paths *paths, const char *list )
+{
+    int status = 0;
+    FILE *file;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+
+    if ( !strcmp ( list, "-" ) )
+    {
+        file = stdin;
+
+    } else if ( !( file = fopen ( list, "r" ) ) )
+    {
+        perror ( list );
+        return -1;
+    }
+
+    while ( !status && ( len = getline ( &line, &size, file ) ) >= 0 )
+    {
+        while ( len > 0 && ( line[len - 1] == '\n' || line[len - 1] == '\r' ) )
+        {
+            line[--len] = '\0';
+        }
+
+        if ( len )
+        {
+            status = fw_paths_add ( paths, line );
+        }
+    }
+
+    free ( line );
+
+    if ( file != stdin )
+    {
+        fclose ( file );
+    }
+
+    return status;
+}
+
+/* Verify group of images left after the cache was asked, -1 if out of memory */
+static int fw_batch_group ( struct fw_pool *pool, unsigned int first, unsigned int count,
+    struct fw_record *records )
+{
+    int status = -1;
+    unsigned int i;
+    unsigned int misses = 0;
+    int *cached;
+    char **paths;
+    struct fw_cache_key *keys;
+    struct fw_record *pending;
+
+    cached = ( int * ) calloc ( count, sizeof ( int ) );
+    paths = ( char ** ) calloc ( count, sizeof ( char * ) );
+    keys = ( struct fw_cache_key * ) calloc ( count, sizeof ( struct fw_cache_key ) );
+    pending = ( struct fw_record * ) calloc ( count, sizeof ( struct fw_record ) );
+
+    if ( cached && paths && keys && pending )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            fw_record_init ( &records[i], pool->format, pool->options,
+                pool->paths->path[first + i] );
+            cached[i] = fw_cache_lookup ( &keys[i], pool->format, pool->options->offset,
+                pool->paths->path[first + i], &records[i] );
+            if ( cached[i] <= 0 )
+            {
+                paths[misses] = pool->paths->path[first + i];
+                fw_record_init ( &pending[misses++], pool->format, pool->options,
+                    pool->paths->path[first + i] );
+            }
+        }
+
+        if ( misses )
+        {
+            pool->format->verify_group ( paths, misses, pool->options, pending );
+        }
+
+        for ( i = 0, misses = 0; i < count; i++ )
+        {
+            if ( cached[i] <= 0 )
+            {
+                records[i] = pending[misses++];
+            }
+
+            if ( !cached[i] )
+            {
+                fw_cache_store ( &keys[i], &records[i] );
+            }
+        }
+
+        status = 0;
+    }
+
+    free ( pending );
+    free ( keys );
+    free ( paths );
+    free ( cached );
+    return status;
+}
+
+/* Verify all images of one task */
+static void fw_batch_task ( struct fw_pool *pool, unsigned int task )
+{
+    int group;
+    unsigned int i;
+    unsigned int first = task * pool->format->group;
+    unsigned int count = pool->paths->count - first;
+    struct fw_record *records;
+
+    if ( count > pool->format->group )
+    {
+        count = pool->format->group;
+    }
+
+    /* missing records are reported as errors */
+    if ( !( records = ( struct fw_record * ) calloc ( count, sizeof ( struct fw_record ) ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return;
+    }
+
+    /* checkpoints are kept per image, grouped images are hashed in full */
+    group = pool->format->verify_group && !( pool->options->index && pool->format->verify );
+
+    if ( group && fw_batch_group ( pool, first, count, records ) < 0 )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            fw_record_init ( &records[i], pool->format, pool->options,
+                pool->paths->path[first + i] );
+        }
+
+        pool->format->verify_group ( pool->paths->path + first, count, pool->options,
+            records );
+    } else if ( !group )
+    {
+        for ( i = 0; i < count; i++ )
+        {
+            fw_verify ( pool->format, pool->options, pool->paths->path[first + i],
+                &records[i] );
+        }
+    }
+
+    pool->records[task] = records;
+}
+
+/* Print every finished task that is next in order */
+static void fw_batch_report ( struct fw_pool *pool, unsigned int task )
+{
+    unsigned int i;
+    unsigned int first;
+    unsigned int end;
+    struct fw_record *records;
+    struct fw_record *record;
+    struct fw_record failed;
+
+    pthread_mutex_lock ( &pool->print_lock );
+    pool->done[task] = TRUE;
+
+    while ( pool->next < pool->tasks && pool->done[pool->next] )
+    {
+        records = pool->records[pool->next];
+        first = pool->next * pool->format->group;
+        end = first + pool->format->group;
+        if ( end > pool->paths->count )
+        {
+            end = pool->paths->count;
+        }
+
+        for ( i = first; i < end; i++ )
+        {
+            if ( records )
+            {
+                record = &records[i - first];
+            } else
+            {
+                record = &failed;
+                fw_record_init ( record, pool->format, pool->options, pool->paths->path[i] );
+                record->result = FW_RESULT_ERROR;
+            }
+
+            if ( fw_output_record ( &pool->output, record ) < 0
+                || record->result == FW_RESULT_ERROR )
+            {
+                pool->errors++;
+            }
+        }
+
+        free ( records );
+        pool->records[pool->next] = NULL;
+        pool->next++;
+    }
+
+    /* everything printable so far goes out in one write */
+    if ( fw_output_flush ( &pool->output ) < 0 )
+    {
+        pool->errors++;
+    }
+
+    pthread_mutex_unlock ( &pool->print_lock );
+}
+
+/* Take next task from own deque, or steal half of another one */
+static int fw_batch_take ( struct fw_pool *pool, unsigned int id, unsigned int *task )
+{
+    unsigned int i;
+    unsigned int n;
+    struct fw_deque *own = &pool->deque[id];
+    struct fw_deque *victim;
+
+    pthread_mutex_lock ( &own->lock );
+    if ( own->head < own->tail )
+    {
+        *task = own->head++;
+        pthread_mutex_unlock ( &own->lock );
+        return TRUE;
+    }
+    pthread_mutex_unlock ( &own->lock );
+
+    for ( i = 1; i < pool->threads; i++ )
+    {
+        victim = &pool->deque[( id + i ) % pool->threads];
+
+        pthread_mutex_lock ( &victim->lock );
+        if ( victim->head < victim->tail )
+        {
+            /* steal back half, owner keeps working from the front */
+            n = ( victim->tail - victim->head + 1 ) / 2;
+            victim->tail -= n;
+            *task = victim->tail;
+            pthread_mutex_unlock ( &victim->lock );
+
+            pthread_mutex_lock ( &own->lock );
+            own->head = *task + 1;
+            own->tail = *task + n;
+            pthread_mutex_unlock ( &own->lock );
+            return TRUE;
+        }
+        pthread_mutex_unlock ( &victim->lock );
+    }
+
+    return FALSE;
+}
+
+/* Batch worker main loop */
+static void *fw_batch_worker ( void *arg )
+{
+    struct fw_worker *worker = ( struct fw_worker * ) arg;
+    struct fw_pool *pool = worker->pool;
+    unsigned int task;
+
+    while ( fw_batch_take ( pool, worker->id, &task ) )
+    {
+        fw_batch_task ( pool, task );
+        fw_batch_report ( pool, task );
+    }
+
+    return NULL;
+}
+
+/* Verify files on a work stealing thread pool, print results in order */
+int fw_batch ( const struct fw_format *format, const struct fw_options *options )
+{
+    int status = 0;
+    unsigned int i;
+    unsigned int started;
+    long cpus;
+    struct stat st;
+    struct fw_paths paths;
+    struct fw_pool pool;
+    pthread_t thread[FW_BATCH_MAX_THREADS];
+    struct fw_worker worker[FW_BATCH_MAX_THREADS];
+
+    if ( !format->verify && !format->verify_group )
+    {
+        fprintf ( stderr, "Error: batch mode is not supported for %s images\n", format->name );
+        return 1;
+    }
+
+    memset ( &paths, '\0', sizeof ( paths ) );
+
+    /* expand command line and list file into paths */
+    for ( i = 0; i < options->count && !status; i++ )
+    {
+        if ( !stat ( options->paths[i], &st ) && S_ISDIR ( st.st_mode ) )
+        {
+            status = fw_paths_add_dir ( &paths, options->paths[i] );
+        } else
+        {
+            status = fw_paths_add ( &paths, options->paths[i] );
+        }
+    }
+
+    if ( !status && options->list )
+    {
+        status = fw_paths_add_list ( &paths, options->list );
+    }
+
+    memset ( &pool, '\0', sizeof ( pool ) );
+    pool.format = format;
+    pool.options = options;
+    pool.paths = &paths;
+    pool.tasks = ( paths.count + format->group - 1 ) / format->group;
+
+    if ( !status && ( !( pool.records = ( struct fw_record ** ) calloc ( pool.tasks + 1,
+                    sizeof ( struct fw_record * ) ) )
+            || !( pool.done = ( unsigned char * ) calloc ( pool.tasks + 1, 1 ) ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        status = -1;
+    }
+
+    if ( !status && fw_output_init ( &pool.output, options->output ) < 0 )
+    {
+        status = -1;
+    }
+
+    if ( !status )
+    {
+        /* one worker per cpu unless told otherwise */
+        if ( !( pool.threads = options->threads ) )
+        {
+            cpus = sysconf ( _SC_NPROCESSORS_ONLN );
+            pool.threads = cpus > 0 ? cpus : 1;
+        }
+
+        if ( pool.threads > FW_BATCH_MAX_THREADS )
+        {
+            pool.threads = FW_BATCH_MAX_THREADS;
+        }
+
+        if ( pool.threads > pool.tasks )
+        {
+            pool.threads = pool.tasks ? pool.tasks : 1;
+        }
+
+        /* tasks are dealt out as contiguous ranges */
+        pthread_mutex_init ( &pool.print_lock, NULL );
+        for ( i = 0; i < pool.threads; i++ )
+        {
+            pthread_mutex_init ( &pool.deque[i].lock, NULL );
+            pool.deque[i].head = ( unsigned long ) pool.tasks * i / pool.threads;
+            pool.deque[i].tail = ( unsigned long ) pool.tasks * ( i + 1 ) / pool.threads;
+            worker[i].pool = &pool;
+            worker[i].id = i;
+        }
+
+        /* calling thread works as worker #0 */
+        for ( started = 1; started < pool.threads; started++ )
+        {
+            if ( pthread_create ( &thread[started], NULL, fw_batch_worker, &worker[started] ) )
+            {
+                break;
+            }
+        }
+
+        fw_batch_worker ( &worker[0] );
+
+        for ( i = 1; i < started; i++ )
+        {
+            pthread_join ( thread[i], NULL );
+        }
+
+        for ( i = 0; i < pool.threads; i++ )
+        {
+            pthread_mutex_destroy ( &pool.deque[i].lock );
+        }
+        pthread_mutex_destroy ( &pool.print_lock );
+
+        if ( fw_output_free ( &pool.output ) < 0 || pool.errors )
+        {
+            status = -1;
+        }
+    }
+
+    for ( i = 0; i < paths.count; i++ )
+    {
+        free ( paths.path[i] );
+    }
+
+    free ( paths.path );
+    free ( pool.records );
+    free ( pool.done );
+
+    return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,426 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - BCM Format
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+#include "bcmcrc32.h"
+
+#define SDUMP(N, V) \
+    hdr_dump_string(N, V, sizeof(V)); \
+    printf("\n");
+
+#define SDUMP2(N, V) \
+    hdr_dump_string(N, V, sizeof(V));
+
+/* Copy firmware header string into buffer */
+static void hdr_dump_string ( const char *prefix, const unsigned char *src, size_t src_size )
+{
+    size_t src_len;
+    char dest[256];
+
+    for ( src_len = 0; src_len < src_size; src_len++ )
+    {
+        if ( src[src_len] == '\0' )
+        {
+            break;
+        }
+    }
+
+    if ( src_len >= sizeof ( dest ) )
+    {
+        return;
+    }
+
+    memcpy ( dest, src, src_len );
+    dest[src_len] = '\0';
+
+    printf ( "%s: %s", prefix, dest );
+}
+
+/* Copy firmware header string into buffer */
+static int hdr_copy_string ( char *dest, size_t dest_size, const unsigned char *src,
+    size_t src_size )
+{
+    size_t src_len;
+
+    for ( src_len = 0; src_len < src_size; src_len++ )
+    {
+        if ( src[src_len] == '\0' )
+        {
+            break;
+        }
+    }
+
+    if ( dest_size <= src_len )
+    {
+        return -1;
+    }
+
+    memcpy ( dest, src, src_len );
+    dest[src_len] = '\0';
+    return 0;
+}
+
+/* Check for BCM header */
+static int bcm_probe ( const unsigned char *header, size_t len )
+{
+    return len >= sizeof ( struct bcm_header_v1 )
+        && header[0] == 0x36 && !header[1] && !header[2] && !header[3];
+}
+
+/* Get BCM image length, 0 if header checksum does not match */
+static size_t bcm_extent ( const unsigned char *header, size_t len )
+{
+    unsigned int total_size;
+    uint32_t header_crc32;
+    char str[32];
+
+    /* the magic is weak, the header checksum is not */
+    memcpy ( &header_crc32, header + offsetof ( struct bcm_header_v1, header_crc32 ),
+        sizeof ( header_crc32 ) );
+    if ( header_crc32 != htonl ( crc32buf ( ( unsigned char * ) header, 236 ) ) )
+    {
+        return 0;
+    }
+
+    if ( hdr_copy_string ( str, sizeof ( str ), header + offsetof ( struct bcm_header_v1,
+                total_size ), sizeof ( ( ( struct bcm_header_v1 * ) 0 )->total_size ) ) < 0
+        || sscanf ( str, "%u", &total_size ) <= 0 || 256 + ( size_t ) total_size > len )
+    {
+        return 0;
+    }
+
+    return 256 + ( size_t ) total_size;
+}
+
+/* Checksums computed over BCM image, byte order as stored in header */
+struct bcm_sums
+{
+    unsigned int total_size;
+    size_t size;
+    uint32_t data_crc32;
+    uint32_t rootfs_crc32;
+    uint32_t kernel_crc32;
+    uint32_t header_crc32;
+};
+
+/* Validate BCM header and parse payload sizes */
+static int bcm_parse ( const struct fw_image *image, unsigned int *total_size,
+    unsigned int *loader_size, unsigned int *rootfs_size, unsigned int *kernel_size )
+{
+    size_t size = fw_image_size ( image );
+    struct bcm_header_v1 *header = ( struct bcm_header_v1 * ) image->header;
+    char str[32];
+
+    if ( image->header_len < sizeof ( struct bcm_header_v1 )
+        || header->magic[0] != 0x36 || header->magic[1] || header->magic[2] || header->magic[3] )
+    {
+        fprintf ( stderr, "Error: bcm header not found\n" );
+        return -1;
+    }
+
+    *total_size = 0;
+    *loader_size = 0;
+    *rootfs_size = 0;
+    *kernel_size = 0;
+
+    /* parse total size */
+    if ( hdr_copy_string ( str, sizeof ( str ), header->total_size,
+            sizeof ( header->total_size ) ) < 0 || sscanf ( str, "%u", total_size ) <= 0 )
+    {
+        fprintf ( stderr, "Error: failed to parse total size\n" );
+        return -1;
+    }
+
+    /* parse loader size */
+    if ( hdr_copy_string ( str, sizeof ( str ), header->loader_size,
+            sizeof ( header->loader_size ) ) < 0 || sscanf ( str, "%u", loader_size ) <= 0 )
+    {
+        fprintf ( stderr, "Error: failed to parse loader size\n" );
+        return -1;
+    }
+
+    /* parse rootfs size */
+    if ( hdr_copy_string ( str, sizeof ( str ), header->rootfs_size,
+            sizeof ( header->rootfs_size ) ) < 0 || sscanf ( str, "%u", rootfs_size ) <= 0 )
+    {
+        fprintf ( stderr, "Error: failed to parse rootfs size\n" );
+        return -1;
+    }
+
+    /* parse kernel size */
+    if ( hdr_copy_string ( str, sizeof ( str ), header->kernel_size,
+            sizeof ( header->kernel_size ) ) < 0 || sscanf ( str, "%u", kernel_size ) <= 0 )
+    {
+        fprintf ( stderr, "Error: failed to parse kernel size\n" );
+        return -1;
+    }
+
+    if ( size != FW_TO_END && size < 256 + ( size_t ) *loader_size + *kernel_size + *rootfs_size )
+    {
+        fprintf ( stderr, "Error: no data left to check with crc32\n" );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Validate BCM header and compute its checksums */
+static int bcm_check ( struct fw_image *image, struct bcm_sums *sums )
+{
+    uint32_t loader_crc32;
+    uint32_t rootfs_crc32;
+    uint32_t kernel_crc32;
+    uint32_t tail_crc32;
+    uint32_t data_crc32;
+    unsigned int loader_size;
+    unsigned int rootfs_size;
+    unsigned int kernel_size;
+    size_t size;
+    size_t tail_size;
+
+    if ( bcm_parse ( image, &sums->total_size, &loader_size, &rootfs_size,
+            &kernel_size ) < 0 )
+    {
+        return -1;
+    }
+
+    /* checksum each payload region once, data crc is combined from them */
+    if ( fw_image_crc32 ( image, 256, loader_size, &loader_crc32 ) < 0
+        || fw_image_crc32 ( image, 256 + ( size_t ) loader_size, rootfs_size,
+            &rootfs_crc32 ) < 0
+        || fw_image_crc32 ( image, 256 + ( size_t ) loader_size + rootfs_size, kernel_size,
+            &kernel_crc32 ) < 0
+        || fw_image_crc32 ( image, 256 + ( size_t ) loader_size + rootfs_size + kernel_size,
+            FW_TO_END, &tail_crc32 ) < 0 )
+    {
+        return -1;
+    }
+
+    /* streamed input has been consumed, its size is known now */
+    size = fw_image_size ( image );
+    tail_size = size - 256 - loader_size - rootfs_size - kernel_size;
+
+    data_crc32 = crc32_combine ( loader_crc32, rootfs_crc32, rootfs_size );
+    data_crc32 = crc32_combine ( data_crc32, kernel_crc32, kernel_size );
+    data_crc32 = crc32_combine ( data_crc32, tail_crc32, tail_size );
+
+    sums->size = size;
+    sums->data_crc32 = htonl ( data_crc32 );
+    sums->rootfs_crc32 = htonl ( rootfs_crc32 );
+    sums->kernel_crc32 = htonl ( kernel_crc32 );
+    sums->header_crc32 = htonl ( crc32buf ( image->header, 236 ) );
+
+    return 0;
+}
+
+/* Verify BCM image, update checksums if needed */
+static int bcm_process ( struct fw_image *image, const struct fw_options *options )
+{
+    struct bcm_header_v1 *header = ( struct bcm_header_v1 * ) image->header;
+    struct bcm_sums sums;
+
+    if ( bcm_check ( image, &sums ) < 0 )
+    {
+        return -1;
+    }
+
+    /* dump bcm header */
+    printf ( "bcm magic   : %.2x %.2x %.2x %.2x\n",
+        ( ( unsigned char * ) ( &header->magic ) )[0],
+        ( ( unsigned char * ) ( &header->magic ) )[1],
+        ( ( unsigned char * ) ( &header->magic ) )[2],
+        ( ( unsigned char * ) ( &header->magic ) )[3] );
+
+    SDUMP ( "bcm vendor  ", header->vendor );
+    SDUMP ( "bcm version ", header->version );
+    SDUMP ( "bcm board   ", header->board_id );
+    SDUMP ( "bcm chip    ", header->chip_id );
+    printf ( "cpu endian  : %s ENDIAN\n", header->endian_flag[0] == 0x31 ? "BIG" : "LITTLE" );
+
+    SDUMP2 ( "total  size ", header->total_size );
+    printf ( " (%s)\n", 256 + sums.total_size == sums.size ? "ok" : "bad" );
+    SDUMP ( "loader addr ", header->loader_addr );
+    SDUMP ( "loader size ", header->loader_size );
+    SDUMP ( "rootfs addr ", header->rootfs_addr );
+    SDUMP ( "rootfs size ", header->rootfs_size );
+    SDUMP ( "kernel addr ", header->kernel_addr );
+    SDUMP ( "kernel size ", header->kernel_size );
+
+    printf ( "data   crc  : 0x%.8x (%s)\n", ntohl ( header->data_crc32 ),
+        header->data_crc32 == sums.data_crc32 ? "correct" : "incorrect" );
+    printf ( "rootfs crc  : 0x%.8x (%s)\n", ntohl ( header->rootfs_crc32 ),
+        header->rootfs_crc32 == sums.rootfs_crc32 ? "correct" : "incorrect" );
+    printf ( "kernel crc  : 0x%.8x (%s)\n", ntohl ( header->kernel_crc32 ),
+        header->kernel_crc32 == sums.kernel_crc32 ? "correct" : "incorrect" );
+    printf ( "sequence    : 0x%.8x\n", header->sequence );
+    printf ( "root length : 0x%.8x\n", header->root_length );
+    printf ( "header crc  : 0x%.8x (%s)\n", ntohl ( header->header_crc32 ),
+        header->header_crc32 == sums.header_crc32 ? "correct" : "incorrect" );
+    printf ( "\n" );
+
+    /* update crc32 checksum if needed */
+    if ( !options->readonly && ( header->data_crc32 != sums.data_crc32
+            || header->rootfs_crc32 != sums.rootfs_crc32
+            || header->kernel_crc32 != sums.kernel_crc32
+            || header->header_crc32 != sums.header_crc32 ) )
+    {
+        header->data_crc32 = sums.data_crc32;
+        header->rootfs_crc32 = sums.rootfs_crc32;
+        header->kernel_crc32 = sums.kernel_crc32;
+
+        /* payload checksums are part of the header, only it needs rehashing */
+        header->header_crc32 = htonl ( crc32buf ( image->header, 236 ) );
+
+        fw_image_dirty ( image, offsetof ( struct bcm_header_v1, data_crc32 ),
+            offsetof ( struct bcm_header_v1, reserved_2 ) - offsetof ( struct bcm_header_v1,
+                data_crc32 ) );
+
+        if ( fw_image_sync ( image ) < 0 )
+        {
+            return -1;
+        }
+
+        printf ( "Note: checksum has been updated.\n\n" );
+    }
+
+    return 0;
+}
+
+/* Verify BCM image without reporting details */
+static int bcm_verify ( struct fw_image *image, const struct fw_options *options,
+    struct fw_record *record )
+{
+    struct bcm_header_v1 *header = ( struct bcm_header_v1 * ) image->header;
+    struct bcm_sums sums;
+
+    ( void ) options;
+
+    if ( bcm_check ( image, &sums ) < 0 )
+    {
+        return FW_RESULT_ERROR;
+    }
+
+    fw_record_crc32 ( record, "data_crc32", ntohl ( header->data_crc32 ),
+        ntohl ( sums.data_crc32 ) );
+    fw_record_crc32 ( record, "rootfs_crc32", ntohl ( header->rootfs_crc32 ),
+        ntohl ( sums.rootfs_crc32 ) );
+    fw_record_crc32 ( record, "kernel_crc32", ntohl ( header->kernel_crc32 ),
+        ntohl ( sums.kernel_crc32 ) );
+    fw_record_crc32 ( record, "header_crc32", ntohl ( header->header_crc32 ),
+        ntohl ( sums.header_crc32 ) );
+
+    if ( header->data_crc32 != sums.data_crc32 || header->rootfs_crc32 != sums.rootfs_crc32
+        || header->kernel_crc32 != sums.kernel_crc32
+        || header->header_crc32 != sums.header_crc32 )
+    {
+        return FW_RESULT_INCORRECT;
+    }
+
+    return FW_RESULT_CORRECT;
+}
+
+/* Carry crc32 of range start..end over the patched bytes within it */
+static uint32_t bcm_patch_range ( uint32_t crc, size_t start, size_t end,
+    const struct fw_options *options, const unsigned char *old )
+{
+    size_t from = options->patch_off > start ? options->patch_off : start;
+    size_t to = options->patch_off + options->patch_len;
+
+    to = to < end ? to : end;
+    if ( from >= to )
+    {
+        return crc;
+    }
+
+    return crc32_patch ( crc, old + ( from - options->patch_off ),
+        options->patch + ( from - options->patch_off ), to - from, end - to );
+}
+
+/* Patch BCM payload in place, checksums follow the delta */
+static int bcm_patch ( struct fw_image *image, const struct fw_options *options )
+{
+    uint32_t data_crc32;
+    uint32_t rootfs_crc32;
+    uint32_t kernel_crc32;
+    unsigned int total_size;
+    unsigned int loader_size;
+    unsigned int rootfs_size;
+    unsigned int kernel_size;
+    size_t rootfs_off;
+    size_t kernel_off;
+    size_t size = fw_image_size ( image );
+    unsigned char *old;
+    struct bcm_header_v1 *header = ( struct bcm_header_v1 * ) image->header;
+
+    if ( bcm_parse ( image, &total_size, &loader_size, &rootfs_size, &kernel_size ) < 0 )
+    {
+        return -1;
+    }
+
+    /* header fields are not part of any payload checksum */
+    if ( options->patch_off < 256 || options->patch_off > size
+        || options->patch_len > size - options->patch_off )
+    {
+        fprintf ( stderr, "Error: patch is outside of payload\n" );
+        return -1;
+    }
+
+    if ( !( old = ( unsigned char * ) malloc ( options->patch_len ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( fw_image_patch ( image, options->patch_off, options->patch, options->patch_len,
+            old ) < 0 )
+    {
+        free ( old );
+        return -1;
+    }
+
+    rootfs_off = 256 + ( size_t ) loader_size;
+    kernel_off = rootfs_off + rootfs_size;
+
+    data_crc32 = bcm_patch_range ( ntohl ( header->data_crc32 ), 256, size, options, old );
+    rootfs_crc32 = bcm_patch_range ( ntohl ( header->rootfs_crc32 ), rootfs_off,
+        rootfs_off + rootfs_size, options, old );
+    kernel_crc32 = bcm_patch_range ( ntohl ( header->kernel_crc32 ), kernel_off,
+        kernel_off + kernel_size, options, old );
+    free ( old );
+
+    printf ( "patch       : %lu bytes at %lu\n", ( unsigned long ) options->patch_len,
+        options->patch_off );
+    printf ( "data   crc  : 0x%.8x -> 0x%.8x\n", ntohl ( header->data_crc32 ), data_crc32 );
+    printf ( "rootfs crc  : 0x%.8x -> 0x%.8x\n", ntohl ( header->rootfs_crc32 ), rootfs_crc32 );
+    printf ( "kernel crc  : 0x%.8x -> 0x%.8x\n", ntohl ( header->kernel_crc32 ), kernel_crc32 );
+
+    header->data_crc32 = htonl ( data_crc32 );
+    header->rootfs_crc32 = htonl ( rootfs_crc32 );
+    header->kernel_crc32 = htonl ( kernel_crc32 );
+    header->header_crc32 = htonl ( crc32buf ( image->header, 236 ) );
+    printf ( "header crc  : 0x%.8x\n\n", ntohl ( header->header_crc32 ) );
+
+    fw_image_dirty ( image, offsetof ( struct bcm_header_v1, data_crc32 ),
+        offsetof ( struct bcm_header_v1, reserved_2 ) - offsetof ( struct bcm_header_v1,
+            data_crc32 ) );
+
+    if ( fw_image_sync ( image ) < 0 )
+    {
+        return -1;
+    }
+
+    printf ( "Note: image has been patched.\n\n" );
+    return 0;
+}
+
+const struct fw_format fw_format_bcm = {
+    "bcm",
+    1,
+    bcm_probe,
+    bcm_extent,
+    bcm_process,
+    bcm_verify,
+    NULL,
+    bcm_patch
+};
@@ -0,0 +1,473 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Benchmark - Main Program File
+ * ------------------------------------------------------------------ */
+
+#include <sys/wait.h>
+#include <time.h>
+
+#include "fwsynth.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_RUNS_MAX 1000
+#define BENCH_SCRUB_SIZE (64 << 20)     /* larger than any last level cache */
+
+/* Benchmark settings */
+struct bench
+{
+    unsigned int runs;
+    const char *commit;
+    const char *dir;            /* where images are generated */
+    const char *tools;          /* where tool binaries are */
+    unsigned char *scrub;       /* evicts cpu caches between cold runs */
+};
+
+/* Timings of every run of one case */
+struct bench_samples
+{
+    double ns[BENCH_RUNS_MAX];
+    uint64_t cycles[BENCH_RUNS_MAX];
+};
+
+/* Synthetic image of one format */
+struct bench_image
+{
+    const char *format;
+    const char *tool;
+    char path[4096];
+};
+
+/* Show program usage message */
+static void show_usage ( void )
+{
+    fprintf ( stderr, "usage: fwbench [-r runs] [-c commit] [-d dir] [-t tools] size...\n\n"
+        "  -r runs     timed runs per case, 10 by default\n"
+        "  -c commit   revision recorded with every result\n"
+        "  -d dir      directory for generated images, release by default\n"
+        "  -t tools    directory holding trxcrc32, bcmcrc32 and tlmd5, release by default\n"
+        "  size        image and buffer sizes in bytes\n" "\n" );
+}
+
+/* Get monotonic time in nanoseconds */
+static double bench_now ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Get time stamp counter, 0 if there is none */
+static uint64_t bench_cycles ( void )
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    return __rdtsc (  );
+#else
+    return 0;
+#endif
+}
+
+/* Order doubles ascending for qsort */
+static int bench_cmp_double ( const void *a, const void *b )
+{
+    double x = *( const double * ) a;
+    double y = *( const double * ) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Order counters ascending for qsort */
+static int bench_cmp_u64 ( const void *a, const void *b )
+{
+    uint64_t x = *( const uint64_t * ) a;
+    uint64_t y = *( const uint64_t * ) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Get nearest rank percentile of sorted samples */
+static double bench_pct ( const double *ns, unsigned int runs, unsigned int pct )
+{
+    unsigned int rank = ( pct * runs + 99 ) / 100;
+
+    return ns[rank ? rank - 1 : 0];
+}
+
+/* Print one result as a json line */
+static void bench_report ( const struct bench *bench, const char *name, const char *engine,
+    size_t size, const char *cache, struct bench_samples *samples )
+{
+    double p50;
+    uint64_t cycles;
+
+    qsort ( samples->ns, bench->runs, sizeof ( double ), bench_cmp_double );
+    qsort ( samples->cycles, bench->runs, sizeof ( uint64_t ), bench_cmp_u64 );
+
+    p50 = bench_pct ( samples->ns, bench->runs, 50 );
+    cycles = samples->cycles[( bench->runs - 1 ) / 2];
+
+    printf ( "{\"commit\":\"%s\",\"bench\":\"%s\",\"engine\":\"%s\",\"size\":%lu,"
+        "\"cache\":\"%s\",\"runs\":%u,\"gbps\":%.3f,", bench->commit, name, engine,
+        ( unsigned long ) size, cache, bench->runs, p50 > 0 ? size / p50 : 0.0 );
+
+    if ( cycles )
+    {
+        printf ( "\"cycles_per_byte\":%.3f,", ( double ) cycles / size );
+    } else
+    {
+        printf ( "\"cycles_per_byte\":null," );
+    }
+
+    printf ( "\"min_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f}\n",
+        samples->ns[0] / 1e3, p50 / 1e3, bench_pct ( samples->ns, bench->runs, 90 ) / 1e3,
+        bench_pct ( samples->ns, bench->runs, 99 ) / 1e3 );
+    fflush ( stdout );
+}
+
+/* Evict buffer from cpu caches by writing over a larger one */
+static void bench_scrub ( const struct bench *bench, unsigned int pass )
+{
+    memset ( bench->scrub, pass, BENCH_SCRUB_SIZE );
+}
+
+/* Time crc32buf over buffer */
+static void bench_crc32 ( const struct bench *bench, unsigned char *buf, size_t size, int cold )
+{
+    unsigned int i;
+    double t0;
+    uint64_t c0;
+    volatile uint32_t crc;
+    static struct bench_samples samples;
+
+    crc = crc32buf ( buf, size );
+
+    for ( i = 0; i < bench->runs; i++ )
+    {
+        if ( cold )
+        {
+            bench_scrub ( bench, i );
+        }
+
+        t0 = bench_now (  );
+        c0 = bench_cycles (  );
+        crc = crc32buf ( buf, size );
+        samples.cycles[i] = bench_cycles (  ) - c0;
+        samples.ns[i] = bench_now (  ) - t0;
+    }
+
+    ( void ) crc;
+    bench_report ( bench, "crc32buf", crc32_engine (  ), size, cold ? "cold" : "hot",
+        &samples );
+}
+
+/* Time MD5_Update over buffer */
+static void bench_md5 ( const struct bench *bench, unsigned char *buf, size_t size, int cold )
+{
+    unsigned int i;
+    double t0;
+    uint64_t c0;
+    MD5_CTX ctx;
+    unsigned char digest[16];
+    static struct bench_samples samples;
+
+    MD5_Init ( &ctx );
+    MD5_Update ( &ctx, buf, size );
+
+    for ( i = 0; i < bench->runs; i++ )
+    {
+        if ( cold )
+        {
+            bench_scrub ( bench, i );
+        }
+
+        t0 = bench_now (  );
+        c0 = bench_cycles (  );
+        MD5_Init ( &ctx );
+        MD5_Update ( &ctx, buf, size );
+        MD5_Final ( digest, &ctx );
+        samples.cycles[i] = bench_cycles (  ) - c0;
+        samples.ns[i] = bench_now (  ) - t0;
+    }
+
+    bench_report ( bench, "MD5_Update", MD5_Engine (  ), size, cold ? "cold" : "hot",
+        &samples );
+}
+
+/* Run tool on file with its output discarded, -1 if it failed */
+static int bench_exec ( const char *tool, const char *arg, const char *path )
+{
+    int fd;
+    int status;
+    pid_t pid;
+    char *argv[4];
+
+    if ( ( pid = fork (  ) ) < 0 )
+    {
+        perror ( "fork" );
+        return -1;
+    }
+
+    if ( !pid )
+    {
+        if ( ( fd = open ( "/dev/null", O_WRONLY ) ) >= 0 )
+        {
+            dup2 ( fd, STDOUT_FILENO );
+        }
+
+        argv[0] = ( char * ) tool;
+        argv[1] = ( char * ) ( arg ? arg : path );
+        argv[2] = arg ? ( char * ) path : NULL;
+        argv[3] = NULL;
+        execv ( tool, argv );
+        perror ( tool );
+        _exit ( 127 );
+    }
+
+    if ( waitpid ( pid, &status, 0 ) < 0 || !WIFEXITED ( status ) || WEXITSTATUS ( status ) )
+    {
+        fprintf ( stderr, "Error: %s %s failed\n", tool, path );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Drop file from page cache */
+static void bench_drop ( const char *path )
+{
+    int fd;
+
+    if ( ( fd = open ( path, O_RDONLY ) ) >= 0 )
+    {
+        posix_fadvise ( fd, 0, 0, POSIX_FADV_DONTNEED );
+        close ( fd );
+    }
+}
+
+/* Time tool verifying image end to end */
+static int bench_tool ( const struct bench *bench, const struct bench_image *image,
+    size_t size, int cold )
+{
+    unsigned int i;
+    double t0;
+    uint64_t c0;
+    char tool[4096];
+    static struct bench_samples samples;
+
+    snprintf ( tool, sizeof ( tool ), "%s/%s", bench->tools, image->tool );
+
+    if ( bench_exec ( tool, NULL, image->path ) < 0 )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < bench->runs; i++ )
+    {
+        if ( cold )
+        {
+            bench_drop ( image->path );
+        }
+
+        t0 = bench_now (  );
+        c0 = bench_cycles (  );
+        if ( bench_exec ( tool, NULL, image->path ) < 0 )
+        {
+            return -1;
+        }
+        samples.cycles[i] = bench_cycles (  ) - c0;
+        samples.ns[i] = bench_now (  ) - t0;
+    }
+
+    bench_report ( bench, image->tool, strcmp ( image->format, "tplink" ) ? crc32_engine (  )
+        : MD5_Engine (  ), size, cold ? "cold" : "hot", &samples );
+    return 0;
+}
+
+/* Write synthetic image, checksums are filled in by the tool itself */
+static int bench_image_create ( const struct bench *bench, struct bench_image *image,
+    unsigned char *buf, size_t size )
+{
+    int fd;
+    ssize_t ret;
+    size_t done;
+    char tool[4096];
+    struct fw_options options;
+    struct fw_record record;
+    const struct fw_format *format;
+
+    snprintf ( image->path, sizeof ( image->path ), "%s/bench-%lu.%s", bench->dir,
+        ( unsigned long ) size, image->format );
+
+    if ( fw_skeleton ( image->format, buf, size ) < 0 )
+    {
+        fprintf ( stderr, "Error: %lu bytes does not fit %s image\n",
+            ( unsigned long ) size, image->format );
+        return -1;
+    }
+
+    if ( ( fd = open ( image->path, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 )
+    {
+        perror ( image->path );
+        return -1;
+    }
+
+    for ( done = 0; done < size; done += ret )
+    {
+        if ( ( ret = write ( fd, buf + done, size - done ) ) <= 0 )
+        {
+            perror ( "write" );
+            close ( fd );
+            return -1;
+        }
+    }
+
+    close ( fd );
+
+    snprintf ( tool, sizeof ( tool ), "%s/%s", bench->tools, image->tool );
+    if ( bench_exec ( tool, "-u", image->path ) < 0 )
+    {
+        return -1;
+    }
+
+    /* clean pages can be dropped for cold runs */
+    if ( ( fd = open ( image->path, O_RDONLY ) ) >= 0 )
+    {
+        fdatasync ( fd );
+        close ( fd );
+    }
+
+    /* the image must verify, or the numbers are meaningless */
+    memset ( &options, '\0', sizeof ( options ) );
+    options.readonly = TRUE;
+    options.advice = FW_ADVICE_DEFAULT;
+    format = !strcmp ( image->format, "trx" ) ? &fw_format_trx
+        : !strcmp ( image->format, "bcm" ) ? &fw_format_bcm : &fw_format_tplink;
+
+    fw_verify ( format, &options, image->path, &record );
+    if ( record.result != FW_RESULT_CORRECT )
+    {
+        fprintf ( stderr, "Error: generated %s image does not verify\n", image->format );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Run all cases for one size */
+static int bench_size ( const struct bench *bench, size_t size )
+{
+    int status = 0;
+    unsigned int i;
+    unsigned char *buf;
+    struct bench_image images[] = {
+        {"trx", "trxcrc32", ""},
+        {"bcm", "bcmcrc32", ""},
+        {"tplink", "tlmd5", ""}
+    };
+
+    if ( !( buf = ( unsigned char * ) malloc ( size ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    fw_fill ( buf, size, size );
+
+    bench_crc32 ( bench, buf, size, FALSE );
+    bench_crc32 ( bench, buf, size, TRUE );
+    bench_md5 ( bench, buf, size, FALSE );
+    bench_md5 ( bench, buf, size, TRUE );
+
+    for ( i = 0; i < sizeof ( images ) / sizeof ( images[0] ) && !status; i++ )
+    {
+        if ( bench_image_create ( bench, &images[i], buf, size ) < 0
+            || bench_tool ( bench, &images[i], size, FALSE ) < 0
+            || bench_tool ( bench, &images[i], size, TRUE ) < 0 )
+        {
+            status = -1;
+        }
+
+        unlink ( images[i].path );
+    }
+
+    free ( buf );
+    return status;
+}
+
+/* Program main function */
+int main ( int argc, char *argv[] )
+{
+    int arg_off = 1;
+    int status = 0;
+    unsigned long size;
+    struct bench bench;
+
+    memset ( &bench, '\0', sizeof ( bench ) );
+    bench.runs = 10;
+    bench.commit = "unknown";
+    bench.dir = "release";
+    bench.tools = "release";
+
+    /* parse command line */
+    while ( arg_off + 1 < argc && argv[arg_off][0] == '-' )
+    {
+        if ( !strcmp ( argv[arg_off], "-r" ) )
+        {
+            if ( sscanf ( argv[arg_off + 1], "%u", &bench.runs ) <= 0 || !bench.runs
+                || bench.runs > BENCH_RUNS_MAX )
+            {
+                show_usage (  );
+                return 1;
+            }
+
+        } else if ( !strcmp ( argv[arg_off], "-c" ) )
+        {
+            bench.commit = argv[arg_off + 1];
+
+        } else if ( !strcmp ( argv[arg_off], "-d" ) )
+        {
+            bench.dir = argv[arg_off + 1];
+
+        } else if ( !strcmp ( argv[arg_off], "-t" ) )
+        {
+            bench.tools = argv[arg_off + 1];
+
+        } else
+        {
+            show_usage (  );
+            return 1;
+        }
+
+        arg_off += 2;
+    }
+
+    /* validate arguments count */
+    if ( arg_off >= argc )
+    {
+        show_usage (  );
+        return 1;
+    }
+
+    if ( !( bench.scrub = ( unsigned char * ) malloc ( BENCH_SCRUB_SIZE ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return 1;
+    }
+
+    for ( ; arg_off < argc && !status; arg_off++ )
+    {
+        if ( sscanf ( argv[arg_off], "%lu", &size ) <= 0 || !size )
+        {
+            show_usage (  );
+            status = -1;
+            break;
+        }
+
+        status = bench_size ( &bench, size );
+    }
+
+    free ( bench.scrub );
+    return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Binary Header Format
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+#include "binhdr.h"
+
+/* Check for binary header */
+static int binhdr_probe ( const unsigned char *header, size_t len )
+{
+    return len >= sizeof ( struct bin_header )
+        && !memcmp ( header + offsetof ( struct bin_header, ID ), "U2ND", 4 );
+}
+
+/* Get binary header length, 0 if its date is not valid */
+static size_t binhdr_extent ( const unsigned char *header, size_t len )
+{
+    const unsigned char *fwdate = header + offsetof ( struct bin_header, fwdate );
+
+    ( void ) len;
+
+    /* no checksum to rely on, the date has to make sense */
+    if ( fwdate[1] < 1 || fwdate[1] > 12 || fwdate[2] < 1 || fwdate[2] > 31 )
+    {
+        return 0;
+    }
+
+    return sizeof ( struct bin_header );
+}
+
+/* Dump binary header */
+static int binhdr_process ( struct fw_image *image, const struct fw_options *options )
+{
+    struct bin_header *header = ( struct bin_header * ) image->header;
+
+    ( void ) options;
+
+    if ( image->header_len < sizeof ( struct bin_header )
+        || ntohl ( header->ID ) != 0x55324e44 )
+    {
+        fprintf ( stderr, "Error: bcm header not found\n" );
+        return -1;
+    }
+
+    /* dump bin header */
+    printf ( "hdr magic  : %c%c%c%c (%.2x %.2x %.2x %.2x)\n",
+        ( ( unsigned char * ) ( &header->magic ) )[0],
+        ( ( unsigned char * ) ( &header->magic ) )[1],
+        ( ( unsigned char * ) ( &header->magic ) )[2],
+        ( ( unsigned char * ) ( &header->magic ) )[3],
+        ( ( unsigned char * ) ( &header->magic ) )[0],
+        ( ( unsigned char * ) ( &header->magic ) )[1],
+        ( ( unsigned char * ) ( &header->magic ) )[2],
+        ( ( unsigned char * ) ( &header->magic ) )[3] );
+    printf ( "hdr res1   : 0x%.8x\n", header->res1 );
+    printf ( "hdr fwdate : %.2u.%.2u.%.2u\n", header->fwdate[2], header->fwdate[1],
+        2000 + header->fwdate[0] );
+    printf ( "hdr fwvern : %.2u.%.2u.%.2u\n", header->fwvern[0], header->fwvern[1],
+        header->fwvern[2] );
+    printf ( "hdr ID     : %c%c%c%c (%.2x %.2x %.2x %.2x)\n",
+        ( ( unsigned char * ) ( &header->ID ) )[0], ( ( unsigned char * ) ( &header->ID ) )[1],
+        ( ( unsigned char * ) ( &header->ID ) )[2], ( ( unsigned char * ) ( &header->ID ) )[3],
+        ( ( unsigned char * ) ( &header->ID ) )[0], ( ( unsigned char * ) ( &header->ID ) )[1],
+        ( ( unsigned char * ) ( &header->ID ) )[2], ( ( unsigned char * ) ( &header->ID ) )[3] );
+    printf ( "hdr hw_ver : 0x%.2x\n", header->hw_ver );
+    printf ( "hdr s/n    : 0x%.2x\n", header->sn );
+    printf ( "hdr flags  : 0x%.4x\n", header->flags );
+    printf ( "hdr stable : 0x%.4x\n", header->stable );
+    printf ( "hdr try1   : 0x%.4x\n", header->try1 );
+    printf ( "hdr try2   : 0x%.4x\n", header->try2 );
+    printf ( "hdr try3   : 0x%.4x\n", header->try3 );
+    printf ( "hdr res3   : 0x%.4x\n", header->res3 );
+
+    return 0;
+}
+
+const struct fw_format fw_format_binhdr = {
+    "binhdr",
+    1,
+    binhdr_probe,
+    binhdr_extent,
+    binhdr_process,
+    NULL,
+    NULL,
+    NULL
+};
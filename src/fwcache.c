@@ -0,0 +1,319 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Verification Cache
+ * ------------------------------------------------------------------ */
+
+#include <sys/file.h>
+#include <time.h>
+
+#include "fwutils.h"
+
+/*
+ * Results of verified images are kept in a memory mapped hash table,
+ * keyed by what changes whenever the image may have changed, results of
+ * images rewritten by -u or --patch are missed that way too. Each key
+ * lives in one of FW_CACHE_PROBE slots from its home slot, the oldest
+ * guess is evicted when all of them are taken. A cache of a different
+ * layout is wiped and started over, a damaged slot is cleared.
+ */
+
+#define FW_CACHE_MAGIC "FWCACHE1"
+#define FW_CACHE_SLOTS 16384
+#define FW_CACHE_PROBE 8
+#define FW_CACHE_RACY 2000000000ULL     /* ns, mtime coarser than this is trusted */
+
+/* Cache file header */
+struct fw_cache_head
+{
+    char magic[8];
+    uint32_t slots;
+    uint32_t slot_size;
+    unsigned char reserved[48];
+};
+
+/* Cached checksum pair */
+struct fw_cache_check
+{
+    char name[FW_NAME_MAX];
+    uint32_t len;
+    unsigned char stored[FW_SUM_MAX];
+    unsigned char computed[FW_SUM_MAX];
+};
+
+/* Cached verification result */
+struct fw_cache_slot
+{
+    struct fw_cache_key key;
+    uint32_t used;
+    int32_t result;
+    uint64_t size;
+    char format[8];             /* detected format, empty if none */
+    uint32_t count;
+    uint32_t reserved;
+    struct fw_cache_check check[FW_CHECKS_MAX];
+};
+
+static int fw_cache_fd = -1;
+static size_t fw_cache_size;
+static struct fw_cache_head *fw_cache_head;
+static struct fw_cache_slot *fw_cache_slots;
+static pthread_mutex_t fw_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Open cache file and map it, -1 if it cannot be used */
+int fw_cache_open ( const char *path )
+{
+    int fd;
+    void *map;
+    struct stat st;
+    size_t size = sizeof ( struct fw_cache_head )
+        + FW_CACHE_SLOTS * sizeof ( struct fw_cache_slot );
+
+    if ( ( fd = open ( path, O_RDWR | O_CREAT, 0644 ) ) < 0 )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    /* one process at a time, others go without the cache */
+    if ( flock ( fd, LOCK_EX | LOCK_NB ) < 0 )
+    {
+        fprintf ( stderr, "Note: cache %s is in use, not used\n", path );
+        close ( fd );
+        return -1;
+    }
+
+    if ( fstat ( fd, &st ) < 0 )
+    {
+        perror ( "fstat" );
+        close ( fd );
+        return -1;
+    }
+
+    if ( ( size_t ) st.st_size != size && ( ftruncate ( fd, 0 ) < 0
+            || ftruncate ( fd, size ) < 0 ) )
+    {
+        perror ( "ftruncate" );
+        close ( fd );
+        return -1;
+    }
+
+    if ( ( map = mmap ( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) ) == MAP_FAILED )
+    {
+        perror ( "mmap" );
+        close ( fd );
+        return -1;
+    }
+
+    fw_cache_head = ( struct fw_cache_head * ) map;
+    fw_cache_slots = ( struct fw_cache_slot * ) ( fw_cache_head + 1 );
+
+    if ( memcmp ( fw_cache_head->magic, FW_CACHE_MAGIC, sizeof ( fw_cache_head->magic ) )
+        || fw_cache_head->slots != FW_CACHE_SLOTS
+        || fw_cache_head->slot_size != sizeof ( struct fw_cache_slot ) )
+    {
+        memset ( map, '\0', size );
+        memcpy ( fw_cache_head->magic, FW_CACHE_MAGIC, sizeof ( fw_cache_head->magic ) );
+        fw_cache_head->slots = FW_CACHE_SLOTS;
+        fw_cache_head->slot_size = sizeof ( struct fw_cache_slot );
+    }
+
+    fw_cache_fd = fd;
+    fw_cache_size = size;
+    return 0;
+}
+
+/* Unmap and close cache file */
+void fw_cache_close ( void )
+{
+    if ( fw_cache_fd < 0 )
+    {
+        return;
+    }
+
+    munmap ( fw_cache_head, fw_cache_size );
+    close ( fw_cache_fd );
+    fw_cache_fd = -1;
+    fw_cache_head = NULL;
+    fw_cache_slots = NULL;
+}
+
+/* Get home slot of key, FNV-1a over its bytes */
+static uint64_t fw_cache_hash ( const struct fw_cache_key *key )
+{
+    size_t i;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *p = ( const unsigned char * ) key;
+
+    for ( i = 0; i < sizeof ( struct fw_cache_key ); i++ )
+    {
+        hash = ( hash ^ p[i] ) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* Find slot holding key, NULL if none */
+static struct fw_cache_slot *fw_cache_find ( const struct fw_cache_key *key, uint64_t hash )
+{
+    unsigned int i;
+    struct fw_cache_slot *slot;
+
+    for ( i = 0; i < FW_CACHE_PROBE; i++ )
+    {
+        slot = &fw_cache_slots[( hash + i ) % FW_CACHE_SLOTS];
+        if ( slot->used && !memcmp ( &slot->key, key, sizeof ( struct fw_cache_key ) ) )
+        {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+/* Check slot fields that size or index record data, 0 if damaged */
+static int fw_cache_valid ( const struct fw_cache_slot *slot )
+{
+    unsigned int i;
+
+    if ( slot->count > FW_CHECKS_MAX || slot->result < FW_RESULT_CORRECT
+        || slot->result > FW_RESULT_ERROR
+        || !memchr ( slot->format, '\0', sizeof ( slot->format ) ) )
+    {
+        return FALSE;
+    }
+
+    for ( i = 0; i < slot->count; i++ )
+    {
+        if ( slot->check[i].len > FW_SUM_MAX
+            || !memchr ( slot->check[i].name, '\0', FW_NAME_MAX ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Look image up, 1 if record was answered from cache, 0 if not, -1 if not cacheable */
+int fw_cache_lookup ( struct fw_cache_key *key, const struct fw_format *format,
+    unsigned long offset, const char *path, struct fw_record *record )
+{
+    unsigned int i;
+    struct stat st;
+    struct fw_cache_slot *slot;
+
+    if ( fw_cache_fd < 0 || !strcmp ( path, "-" ) || stat ( path, &st ) < 0
+        || !S_ISREG ( st.st_mode ) )
+    {
+        return -1;
+    }
+
+    /* padding free, compared and hashed as bytes */
+    memset ( key, '\0', sizeof ( struct fw_cache_key ) );
+    key->dev = st.st_dev;
+    key->ino = st.st_ino;
+    key->size = st.st_size;
+    key->mtime_ns = ( uint64_t ) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    key->offset = offset;
+    strncpy ( key->format, format->name, sizeof ( key->format ) - 1 );
+
+    pthread_mutex_lock ( &fw_cache_lock );
+
+    if ( !( slot = fw_cache_find ( key, fw_cache_hash ( key ) ) ) )
+    {
+        pthread_mutex_unlock ( &fw_cache_lock );
+        return 0;
+    }
+
+    /* the file may have been damaged, verify again and store anew */
+    if ( !fw_cache_valid ( slot ) )
+    {
+        slot->used = FALSE;
+        pthread_mutex_unlock ( &fw_cache_lock );
+        return 0;
+    }
+
+    record->result = slot->result;
+    record->size = slot->size;
+    record->format = NULL;
+    for ( i = 0; fw_formats[i]; i++ )
+    {
+        if ( !strcmp ( slot->format, fw_formats[i]->name ) )
+        {
+            record->format = fw_formats[i]->name;
+        }
+    }
+
+    record->count = slot->count;
+    for ( i = 0; i < slot->count; i++ )
+    {
+        memcpy ( record->check[i].name, slot->check[i].name, FW_NAME_MAX );
+        record->check[i].len = slot->check[i].len;
+        memcpy ( record->check[i].stored, slot->check[i].stored, FW_SUM_MAX );
+        memcpy ( record->check[i].computed, slot->check[i].computed, FW_SUM_MAX );
+    }
+
+    pthread_mutex_unlock ( &fw_cache_lock );
+    return 1;
+}
+
+/* Keep verified record under key looked up before */
+void fw_cache_store ( const struct fw_cache_key *key, const struct fw_record *record )
+{
+    unsigned int i;
+    uint64_t hash;
+    struct timespec now;
+    struct fw_cache_slot *slot;
+
+    if ( fw_cache_fd < 0 || record->result == FW_RESULT_ERROR )
+    {
+        return;
+    }
+
+    /* a write within the same mtime tick would go unnoticed */
+    clock_gettime ( CLOCK_REALTIME, &now );
+    if ( ( uint64_t ) now.tv_sec * 1000000000 + now.tv_nsec < key->mtime_ns + FW_CACHE_RACY )
+    {
+        return;
+    }
+
+    hash = fw_cache_hash ( key );
+    pthread_mutex_lock ( &fw_cache_lock );
+
+    if ( !( slot = fw_cache_find ( key, hash ) ) )
+    {
+        for ( i = 0; i < FW_CACHE_PROBE; i++ )
+        {
+            slot = &fw_cache_slots[( hash + i ) % FW_CACHE_SLOTS];
+            if ( !slot->used )
+            {
+                break;
+            }
+        }
+
+        if ( i == FW_CACHE_PROBE )
+        {
+            slot = &fw_cache_slots[( hash + ( hash >> 32 ) % FW_CACHE_PROBE ) % FW_CACHE_SLOTS];
+        }
+    }
+
+    memset ( slot, '\0', sizeof ( struct fw_cache_slot ) );
+    slot->key = *key;
+    slot->result = record->result;
+    slot->size = record->size;
+    if ( record->format )
+    {
+        strncpy ( slot->format, record->format, sizeof ( slot->format ) - 1 );
+    }
+
+    slot->count = record->count;
+    for ( i = 0; i < record->count; i++ )
+    {
+        memcpy ( slot->check[i].name, record->check[i].name, FW_NAME_MAX );
+        slot->check[i].len = record->check[i].len;
+        memcpy ( slot->check[i].stored, record->check[i].stored, FW_SUM_MAX );
+        memcpy ( slot->check[i].computed, record->check[i].computed, FW_SUM_MAX );
+    }
+
+    slot->used = TRUE;
+    pthread_mutex_unlock ( &fw_cache_lock );
+}
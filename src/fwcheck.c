@@ -0,0 +1,52 @@
+/* ------------------------------------------------------------------
+ * Firmware Check - Main Program File
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+/* Show program usage message */
+static void show_usage ( void )
+{
+    fprintf ( stderr, "usage: fwcheck [-u] [-s] [-a advice] [-o offset] [--index] file\n"
+        "       fwcheck -b [-s] [-a advice] [-o offset] [-j threads] [-l list]\n"
+        "              [--cache file] file...\n"
+        "       fwcheck -f [-a advice] [-o offset] file\n"
+        "       fwcheck --format f [-f] [-s] [-a advice] [-o offset] [-j threads] file...\n\n"
+        "  -u          optionally update checksum\n"
+        "  -b          verify many files or directories on a thread pool\n"
+        "  -l list     verify files listed in a file, - for stdin\n"
+        "  --cache f   keep -b and --format results in file f, unchanged files are\n"
+        "              not read again; a file whose size or mtime changed, as after\n"
+        "              -u, is verified again\n"
+        "  -f          search whole file for embedded headers, from offset on\n"
+        "  --format f  print json lines, csv or tsv rows with stored and computed\n"
+        "              checksums, verifies many files as -b does unless -f is given\n"
+        "  --stats     print wall and cpu time, bytes, GB/s and page faults of\n"
+        "              open, hash, sync and close to stderr, in the --format given\n"
+        "  --index     keep crc32 of every 1 MiB block in file.crcidx and md5\n"
+        "              midstates every 4 MiB in file.md5idx, unchanged parts are\n"
+        "              not hashed again, mapped files only; -u rehashes the blocks\n"
+        "              it writes, any other change rebuilds the whole crc32 index\n"
+        "  -s          stream file with read() instead of mapping it\n"
+        "  -a advice   mapped access policy: none, sequential, willneed (default),\n"
+        "              populate or hugepage\n"
+        "  -o offset   offset from file beginning\n"
+        "  -j threads  batch worker threads, one per cpu by default\n"
+        "  file        trx, bcm, tp-link or bin header firmware file, - for stdin\n" "\n" );
+}
+
+/* Program main function */
+int main ( int argc, char *argv[] )
+{
+    struct fw_options options;
+
+    /* parse command line */
+    if ( fw_parse_args ( argc, argv, FW_OPT_UPDATE | FW_OPT_THREADS | FW_OPT_BATCH
+            | FW_OPT_SCAN | FW_OPT_FORMAT | FW_OPT_INDEX, &options ) < 0 )
+    {
+        show_usage (  );
+        return 1;
+    }
+
+    return fw_run ( &fw_format_auto, &options );
+}
@@ -0,0 +1,81 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Format Detection
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+/* Known formats, weakest magic last */
+const struct fw_format *const fw_formats[] = {
+    &fw_format_trx,
+    &fw_format_bcm,
+    &fw_format_binhdr,
+    &fw_format_tplink,
+    NULL
+};
+
+/* Find format of image header, NULL if unknown */
+const struct fw_format *fw_format_detect ( const struct fw_image *image )
+{
+    unsigned int i;
+
+    for ( i = 0; fw_formats[i]; i++ )
+    {
+        if ( fw_formats[i]->probe ( image->header, image->header_len ) )
+        {
+            return fw_formats[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Detect image format and process it */
+static int auto_process ( struct fw_image *image, const struct fw_options *options )
+{
+    const struct fw_format *format;
+
+    if ( !( format = fw_format_detect ( image ) ) )
+    {
+        fprintf ( stderr, "Error: unknown firmware format\n" );
+        return -1;
+    }
+
+    printf ( "fw format  : %s\n\n", format->name );
+
+    return format->process ( image, options );
+}
+
+/* Detect image format and verify it without reporting details */
+static int auto_verify ( struct fw_image *image, const struct fw_options *options,
+    struct fw_record *record )
+{
+    const struct fw_format *format;
+
+    if ( !( format = fw_format_detect ( image ) ) )
+    {
+        record->format = NULL;
+        fprintf ( stderr, "Error: unknown firmware format\n" );
+        return FW_RESULT_ERROR;
+    }
+
+    record->format = format->name;
+
+    if ( !format->verify )
+    {
+        fprintf ( stderr, "Error: %s images carry no checksum\n", format->name );
+        return FW_RESULT_ERROR;
+    }
+
+    return format->verify ( image, options, record );
+}
+
+const struct fw_format fw_format_auto = {
+    "auto",
+    1,
+    NULL,
+    NULL,
+    auto_process,
+    auto_verify,
+    NULL,
+    NULL
+};
@@ -0,0 +1,929 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Image Access Layer
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+/* Linux values, glibc only exposes them with _GNU_SOURCE */
+#ifndef SEEK_DATA
+#define SEEK_DATA 3
+#endif
+#ifndef SEEK_HOLE
+#define SEEK_HOLE 4
+#endif
+
+/* Double buffered reader shared with the reader thread */
+struct fw_reader
+{
+    struct fw_image *image;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t off;                 /* next read position, relative to header */
+    size_t left;                /* bytes still to read, FW_TO_END up to eof */
+    size_t len[2];              /* bytes held by each buffer */
+    int full[2];                /* buffer waits for the consumer */
+    int done;                   /* no more buffers will be filled */
+    int error;                  /* read failed */
+    struct fw_stats_mark *stats;        /* phase the reader works for, NULL if none */
+};
+
+/* Read up to len bytes at header relative offset, short only at eof */
+static ssize_t fw_image_read ( struct fw_image *image, unsigned char *buf, size_t off,
+    size_t len )
+{
+    ssize_t ret;
+    size_t total = 0;
+
+    while ( total < len )
+    {
+        if ( image->sequential )
+        {
+            ret = read ( image->fd, buf + total, len - total );
+        } else
+        {
+            ret = pread ( image->fd, buf + total, len - total, image->offset + off + total );
+        }
+
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            perror ( "read" );
+            return -1;
+        }
+
+        if ( !ret )
+        {
+            break;
+        }
+
+        total += ret;
+    }
+
+    return total;
+}
+
+/* Open, map and advise firmware image */
+static int fw_image_attach ( struct fw_image *image, const char *path, int readonly, int mode,
+    int advice, unsigned long offset )
+{
+    ssize_t len;
+    size_t skip;
+    struct stat st;
+
+    memset ( image, '\0', sizeof ( struct fw_image ) );
+    image->mode = mode;
+    image->advice = advice;
+    image->readonly = readonly;
+    image->dirty_start = FW_TO_END;
+
+    if ( !strcmp ( path, "-" ) )
+    {
+        /* checksum cannot be written back into a pipe */
+        if ( !readonly )
+        {
+            fprintf ( stderr, "Error: cannot update checksum on stdin\n" );
+            return -1;
+        }
+
+        if ( ( image->fd = dup ( STDIN_FILENO ) ) < 0 )
+        {
+            perror ( "dup" );
+            return -1;
+        }
+
+        if ( fstat ( image->fd, &st ) < 0 )
+        {
+            close ( image->fd );
+            perror ( "fstat" );
+            return -1;
+        }
+
+        /* pipes can only be read once, front to back */
+        if ( !S_ISREG ( st.st_mode ) )
+        {
+            image->sequential = TRUE;
+            image->mode = mode = FW_IMAGE_STREAMED;
+        }
+
+    } else if ( ( image->fd = open ( path, readonly ? O_RDONLY : O_RDWR ) ) < 0 )
+    {
+        /* open file for mapping */
+        perror ( "open" );
+        return -1;
+    }
+
+    if ( image->sequential )
+    {
+        image->length = FW_TO_END;
+
+    } else
+    {
+        /* obtain file size */
+        if ( ( off_t ) ( image->length = lseek ( image->fd, 0, SEEK_END ) ) < 0 )
+        {
+            close ( image->fd );
+            perror ( "lseek" );
+            return -1;
+        }
+
+        /* restore position in file */
+        if ( lseek ( image->fd, 0, SEEK_SET ) < 0 )
+        {
+            close ( image->fd );
+            perror ( "lseek" );
+            return -1;
+        }
+
+        /* validate offset parameter */
+        if ( offset >= image->length )
+        {
+            close ( image->fd );
+            fprintf ( stderr, "Error: file offset is out of range\n" );
+            return -1;
+        }
+    }
+
+    image->offset = offset;
+
+    if ( mode == FW_IMAGE_STREAMED )
+    {
+        /* two read buffers followed by the buffered header */
+        if ( posix_memalign ( ( void ** ) &image->buffer, FW_ALIGN,
+                2 * FW_CHUNK_SIZE + FW_HEADER_MAX ) )
+        {
+            close ( image->fd );
+            fprintf ( stderr, "Error: out of memory\n" );
+            return -1;
+        }
+
+        image->chunk[0] = image->buffer;
+        image->chunk[1] = image->buffer + FW_CHUNK_SIZE;
+        image->header = image->buffer + 2 * FW_CHUNK_SIZE;
+
+        /* let the kernel read ahead aggressively */
+        if ( !image->sequential )
+        {
+            posix_fadvise ( image->fd, offset, 0, POSIX_FADV_SEQUENTIAL );
+        }
+
+        /* stream has to be consumed up to the header */
+        for ( skip = offset; image->sequential && skip; skip -= len )
+        {
+            if ( ( len = fw_image_read ( image, image->chunk[0], 0,
+                        skip < FW_CHUNK_SIZE ? skip : FW_CHUNK_SIZE ) ) <= 0 )
+            {
+                break;
+            }
+        }
+
+        if ( ( len = fw_image_read ( image, image->header, 0, FW_HEADER_MAX ) ) < 0 )
+        {
+            fw_image_close ( image );
+            return -1;
+        }
+
+        if ( image->sequential && ( skip || !len ) )
+        {
+            fw_image_close ( image );
+            fprintf ( stderr, "Error: file offset is out of range\n" );
+            return -1;
+        }
+
+        /* short header read means the whole stream is known */
+        if ( image->sequential && len < FW_HEADER_MAX )
+        {
+            image->length = offset + len;
+        }
+
+        image->header_len = len;
+        image->pos = len;
+        return 0;
+    }
+
+    /*
+     * Map data from the file into our memory for read & write.
+     * Use MAP_SHARED for Persistent Memory so that stores go
+     * directly to the PM and are globally visible.
+     */
+    if ( ( image->pmaddr = ( unsigned char * )
+            mmap ( NULL, image->length,
+                PROT_READ | ( readonly ? 0 : PROT_WRITE ),
+                MAP_SHARED | ( advice == FW_ADVICE_POPULATE ? MAP_POPULATE : 0 ), image->fd,
+                0 ) ) == MAP_FAILED )
+    {
+        close ( image->fd );
+        perror ( "mmap" );
+        return -1;
+    }
+
+    /* access hints are best effort, failures are ignored */
+    switch ( advice )
+    {
+    case FW_ADVICE_HUGEPAGE:
+#ifdef MADV_HUGEPAGE
+        madvise ( image->pmaddr, image->length, MADV_HUGEPAGE );
+#endif
+        /* fall through */
+    case FW_ADVICE_SEQUENTIAL:
+        madvise ( image->pmaddr, image->length, MADV_SEQUENTIAL );
+        break;
+    case FW_ADVICE_WILLNEED:
+        madvise ( image->pmaddr, image->length, MADV_WILLNEED );
+        break;
+    }
+
+    image->header = image->pmaddr + offset;
+    image->header_len = image->length - offset;
+
+    return 0;
+}
+
+/* Open firmware image for processing */
+int fw_image_open ( struct fw_image *image, const char *path, int readonly, int mode,
+    int advice, unsigned long offset )
+{
+    int status;
+    struct fw_stats_mark mark;
+
+    fw_stats_begin ( &mark );
+    status = fw_image_attach ( image, path, readonly, mode, advice, offset );
+    fw_stats_end ( &mark, FW_PHASE_OPEN, 0 );
+
+    return status;
+}
+
+/* Release firmware image resources */
+void fw_image_close ( struct fw_image *image )
+{
+    struct fw_stats_mark mark;
+
+    fw_stats_begin ( &mark );
+
+    if ( image->pmaddr )
+    {
+        munmap ( image->pmaddr, image->length );
+    }
+
+    free ( image->buffer );
+    close ( image->fd );
+
+    fw_stats_end ( &mark, FW_PHASE_CLOSE, 0 );
+}
+
+/* Get image size starting at header, FW_TO_END while stream is not consumed */
+size_t fw_image_size ( const struct fw_image *image )
+{
+    if ( image->length == FW_TO_END )
+    {
+        return FW_TO_END;
+    }
+
+    return image->length - image->offset;
+}
+
+/* Narrow mapped image to an embedded image, the view is not to be closed */
+void fw_image_view ( const struct fw_image *image, size_t off, size_t len,
+    struct fw_image *view )
+{
+    memcpy ( view, image, sizeof ( struct fw_image ) );
+    view->readonly = TRUE;
+    view->offset = image->offset + off;
+    view->length = view->offset + len;
+    view->header = image->header + off;
+    view->header_len = len;
+    view->dirty_start = FW_TO_END;
+    view->dirty_end = 0;
+    view->index = NULL;
+}
+
+/* Reader thread, fills both buffers in turn ahead of the consumer */
+static void *fw_reader_run ( void *arg )
+{
+    struct fw_reader *reader = ( struct fw_reader * ) arg;
+    struct fw_image *image = reader->image;
+    unsigned int slot = 0;
+    size_t want;
+    ssize_t ret;
+
+    for ( ;; )
+    {
+        pthread_mutex_lock ( &reader->lock );
+        while ( reader->full[slot] )
+        {
+            pthread_cond_wait ( &reader->cond, &reader->lock );
+        }
+        pthread_mutex_unlock ( &reader->lock );
+
+        /* keep file reads aligned after the first one */
+        want = FW_CHUNK_SIZE;
+        if ( !image->sequential )
+        {
+            want -= ( image->offset + reader->off ) & ( FW_ALIGN - 1 );
+        }
+        if ( want > reader->left )
+        {
+            want = reader->left;
+        }
+
+        ret = fw_image_read ( image, image->chunk[slot], reader->off, want );
+
+        pthread_mutex_lock ( &reader->lock );
+        if ( ret < 0 )
+        {
+            reader->error = TRUE;
+            reader->done = TRUE;
+
+        } else
+        {
+            reader->len[slot] = ret;
+            reader->full[slot] = ret > 0;
+            reader->off += ret;
+            if ( reader->left != FW_TO_END )
+            {
+                reader->left -= ret;
+            }
+            reader->done = ( size_t ) ret < want || !reader->left;
+        }
+        pthread_cond_signal ( &reader->cond );
+        pthread_mutex_unlock ( &reader->lock );
+
+        if ( reader->done )
+        {
+            break;
+        }
+
+        slot ^= 1;
+    }
+
+    fw_stats_thread ( reader->stats );
+    return NULL;
+}
+
+/* Pass streamed range to consumer, overlapping reads with processing */
+static int fw_image_stream ( struct fw_image *image, size_t off, size_t len, fw_walk_t fn,
+    void *arg )
+{
+    unsigned int slot = 0;
+    ssize_t ret;
+    pthread_t thread;
+    struct fw_reader reader;
+
+    /* small ranges are not worth a thread */
+    if ( len <= FW_CHUNK_SIZE )
+    {
+        if ( ( ret = fw_image_read ( image, image->chunk[0], off, len ) ) < 0 )
+        {
+            return -1;
+        }
+
+        if ( ( size_t ) ret < len )
+        {
+            fprintf ( stderr, "Error: unexpected end of file\n" );
+            return -1;
+        }
+
+        if ( fn )
+        {
+            fn ( arg, image->chunk[0], len );
+        }
+
+        image->pos = off + len;
+        return 0;
+    }
+
+    memset ( &reader, '\0', sizeof ( reader ) );
+    reader.image = image;
+    reader.off = off;
+    reader.left = len;
+    reader.stats = fw_stats_current (  );
+    pthread_mutex_init ( &reader.lock, NULL );
+    pthread_cond_init ( &reader.cond, NULL );
+
+    if ( pthread_create ( &thread, NULL, fw_reader_run, &reader ) )
+    {
+        pthread_cond_destroy ( &reader.cond );
+        pthread_mutex_destroy ( &reader.lock );
+        fprintf ( stderr, "Error: failed to start reader thread\n" );
+        return -1;
+    }
+
+    for ( ;; )
+    {
+        pthread_mutex_lock ( &reader.lock );
+        while ( !reader.full[slot] && !reader.done )
+        {
+            pthread_cond_wait ( &reader.cond, &reader.lock );
+        }
+        if ( !reader.full[slot] )
+        {
+            pthread_mutex_unlock ( &reader.lock );
+            break;
+        }
+        pthread_mutex_unlock ( &reader.lock );
+
+        if ( fn )
+        {
+            fn ( arg, image->chunk[slot], reader.len[slot] );
+        }
+
+        pthread_mutex_lock ( &reader.lock );
+        reader.full[slot] = FALSE;
+        pthread_cond_signal ( &reader.cond );
+        pthread_mutex_unlock ( &reader.lock );
+
+        slot ^= 1;
+    }
+
+    pthread_join ( thread, NULL );
+    pthread_cond_destroy ( &reader.cond );
+    pthread_mutex_destroy ( &reader.lock );
+
+    if ( reader.error )
+    {
+        return -1;
+    }
+
+    image->pos = reader.off;
+
+    if ( reader.left == FW_TO_END )
+    {
+        /* stream consumed, its size is known from now on */
+        image->length = image->offset + reader.off;
+
+    } else if ( reader.left )
+    {
+        fprintf ( stderr, "Error: unexpected end of file\n" );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Pass mapped range to consumer by window, reading ahead and dropping pages behind */
+static void fw_image_window ( struct fw_image *image, size_t off, size_t len, fw_walk_t fn,
+    void *arg )
+{
+    size_t n;
+    size_t start;
+    size_t end;
+    size_t pos = image->offset + off;
+    size_t page = sysconf ( _SC_PAGESIZE );
+
+    while ( len )
+    {
+        n = len < FW_WINDOW ? len : FW_WINDOW;
+
+        /* start reading the next window while this one is processed */
+        if ( len > n )
+        {
+            start = ( pos + n ) & ~( page - 1 );
+            end = pos + n + ( len - n < FW_WINDOW ? len - n : FW_WINDOW );
+            madvise ( image->pmaddr + start, end - start, MADV_WILLNEED );
+        }
+
+        fn ( arg, image->pmaddr + pos, n );
+
+        /* whole pages already consumed leave the working set */
+        start = ( pos + page - 1 ) & ~( page - 1 );
+        end = ( pos + n ) & ~( page - 1 );
+        if ( end > start )
+        {
+            madvise ( image->pmaddr + start, end - start, MADV_DONTNEED );
+        }
+
+        pos += n;
+        len -= n;
+    }
+}
+
+/* Pass image range to consumer, offsets are relative to header */
+int fw_image_walk ( struct fw_image *image, size_t off, size_t len, fw_walk_t fn, void *arg )
+{
+    size_t size = fw_image_size ( image );
+    size_t n;
+
+    if ( size != FW_TO_END )
+    {
+        if ( len == FW_TO_END )
+        {
+            len = off <= size ? size - off : 0;
+        }
+
+        if ( off > size || len > size - off )
+        {
+            fprintf ( stderr, "Error: image data out of range\n" );
+            return -1;
+        }
+    }
+
+    if ( image->mode == FW_IMAGE_MAPPED )
+    {
+        if ( image->advice == FW_ADVICE_SEQUENTIAL || image->advice == FW_ADVICE_HUGEPAGE )
+        {
+            fw_image_window ( image, off, len, fn, arg );
+        } else
+        {
+            fn ( arg, image->header + off, len );
+        }
+        return 0;
+    }
+
+    /* leading bytes may already sit in the header buffer */
+    if ( off < image->header_len && len )
+    {
+        n = image->header_len - off < len ? image->header_len - off : len;
+        fn ( arg, image->header + off, n );
+        off += n;
+        if ( len != FW_TO_END )
+        {
+            len -= n;
+        }
+    }
+
+    if ( !len )
+    {
+        return 0;
+    }
+
+    if ( image->sequential )
+    {
+        if ( off < image->pos )
+        {
+            fprintf ( stderr, "Error: stream cannot be rewound\n" );
+            return -1;
+        }
+
+        /* drop the gap up to the requested range */
+        if ( off > image->pos && fw_image_stream ( image, image->pos, off - image->pos,
+                NULL, NULL ) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    return fw_image_stream ( image, off, len, fn, arg );
+}
+
+/* Crc32 consumer for fw_image_walk */
+static void fw_walk_crc32 ( void *arg, const unsigned char *buf, size_t len )
+{
+    uint32_t *crc = ( uint32_t * ) arg;
+
+    *crc = crc32_update ( *crc, buf, len );
+}
+
+/* Get bytes of range walked, for statistics */
+static size_t fw_image_span ( const struct fw_image *image, size_t off, size_t len )
+{
+    size_t size = fw_image_size ( image );
+
+    if ( len == FW_TO_END )
+    {
+        len = size != FW_TO_END && off <= size ? size - off : 0;
+    }
+
+    return len;
+}
+
+/* Get bytes of data or hole at header relative offset, up to len, TRUE if data */
+static int fw_image_extent ( const struct fw_image *image, size_t off, size_t len, size_t *n )
+{
+    off_t pos = image->offset + off;
+    off_t next;
+    int data = TRUE;
+
+    *n = len;
+
+    /* streams and buffered header bytes are taken as they are */
+    if ( image->sequential )
+    {
+        return TRUE;
+    }
+
+    if ( image->mode != FW_IMAGE_MAPPED && off < image->header_len )
+    {
+        *n = image->header_len - off < len ? image->header_len - off : len;
+        return TRUE;
+    }
+
+    /* bytes changed in memory may not be allocated on disk yet */
+    if ( off >= image->dirty_start && off < image->dirty_end )
+    {
+        *n = image->dirty_end - off < len ? image->dirty_end - off : len;
+        return TRUE;
+    }
+
+    /* ENXIO means only a hole is left, other errors mean no hole support */
+    if ( ( next = lseek ( image->fd, pos, SEEK_DATA ) ) < 0 )
+    {
+        data = errno != ENXIO;
+    } else if ( next > pos )
+    {
+        data = FALSE;
+        *n = ( size_t ) ( next - pos ) < len ? ( size_t ) ( next - pos ) : len;
+    } else if ( ( next = lseek ( image->fd, pos, SEEK_HOLE ) ) > pos )
+    {
+        *n = ( size_t ) ( next - pos ) < len ? ( size_t ) ( next - pos ) : len;
+    }
+
+    if ( !data && off < image->dirty_start && *n > image->dirty_start - off )
+    {
+        *n = image->dirty_start - off;
+    }
+
+    return data;
+}
+
+/* Walk image range into crc32, holes read as zeros are fast-forwarded */
+static int fw_image_crc32_holes ( struct fw_image *image, size_t off, size_t len,
+    uint32_t * crc )
+{
+    size_t size = fw_image_size ( image );
+    size_t n;
+
+    if ( size == FW_TO_END || off > size || ( len != FW_TO_END && len > size - off ) )
+    {
+        return fw_image_walk ( image, off, len, fw_walk_crc32, crc );
+    }
+
+    if ( len == FW_TO_END )
+    {
+        len = size - off;
+    }
+
+    for ( ; len; off += n, len -= n )
+    {
+        if ( !fw_image_extent ( image, off, len, &n ) )
+        {
+            *crc = crc32_fill ( *crc, 0, n );
+        } else if ( fw_image_walk ( image, off, n, fw_walk_crc32, crc ) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Calculate crc32 checksum of image range */
+int fw_image_crc32 ( struct fw_image *image, size_t off, size_t len, uint32_t * crc )
+{
+    int status;
+    size_t hashed = 0;
+    struct fw_stats_mark mark;
+
+    fw_stats_begin ( &mark );
+
+    if ( image->index )
+    {
+        status = fw_index_crc32 ( image, off, len, 1, crc, &hashed );
+        fw_stats_end ( &mark, FW_PHASE_HASH, hashed );
+        return status;
+    }
+
+    *crc = 0xFFFFFFFF;
+    status = fw_image_crc32_holes ( image, off, len, crc );
+    fw_stats_end ( &mark, FW_PHASE_HASH, fw_image_span ( image, off, len ) );
+
+    return status;
+}
+
+/* Account crc32 helper thread to the hash phase */
+static void fw_image_crc32_done ( void *arg )
+{
+    fw_stats_thread ( ( struct fw_stats_mark * ) arg );
+}
+
+/* Calculate crc32 checksum of image range using multiple threads */
+int fw_image_crc32_mt ( struct fw_image *image, size_t off, size_t len, unsigned int threads,
+    uint32_t * crc )
+{
+    int status;
+    size_t hashed = 0;
+    size_t size = fw_image_size ( image );
+    size_t left;
+    size_t n;
+    struct fw_stats_mark mark;
+
+    if ( image->index )
+    {
+        fw_stats_begin ( &mark );
+        status = fw_index_crc32 ( image, off, len, threads, crc, &hashed );
+        fw_stats_end ( &mark, FW_PHASE_HASH, hashed );
+        return status;
+    }
+
+    if ( image->mode != FW_IMAGE_MAPPED || threads <= 1 )
+    {
+        return fw_image_crc32 ( image, off, len, crc );
+    }
+
+    if ( len == FW_TO_END )
+    {
+        len = off <= size ? size - off : 0;
+    }
+
+    if ( off > size || len > size - off )
+    {
+        fprintf ( stderr, "Error: image data out of range\n" );
+        return -1;
+    }
+
+    fw_stats_begin ( &mark );
+    for ( *crc = 0xFFFFFFFF, left = len; left; off += n, left -= n )
+    {
+        if ( fw_image_extent ( image, off, left, &n ) )
+        {
+            *crc = crc32_combine ( *crc, crc32buf_mt_done ( image->header + off, n, threads,
+                    fw_image_crc32_done, &mark ), n );
+        } else
+        {
+            *crc = crc32_fill ( *crc, 0, n );
+        }
+    }
+    fw_stats_end ( &mark, FW_PHASE_HASH, len );
+
+    return 0;
+}
+
+/* Md5 consumer for fw_image_walk */
+static void fw_walk_md5 ( void *arg, const unsigned char *buf, size_t len )
+{
+    MD5_Update ( ( MD5_CTX * ) arg, buf, len );
+}
+
+/* Feed image range into md5 context */
+int fw_image_md5 ( struct fw_image *image, size_t off, size_t len, MD5_CTX * ctx )
+{
+    int status;
+    size_t hashed = 0;
+    struct fw_stats_mark mark;
+
+    fw_stats_begin ( &mark );
+
+    /* streams up to the end resume from checkpoints */
+    if ( image->index && len == FW_TO_END )
+    {
+        status = fw_index_md5 ( image, off, ctx, &hashed );
+        fw_stats_end ( &mark, FW_PHASE_HASH, hashed );
+        return status;
+    }
+
+    status = fw_image_walk ( image, off, len, fw_walk_md5, ctx );
+    fw_stats_end ( &mark, FW_PHASE_HASH, fw_image_span ( image, off, len ) );
+
+    return status;
+}
+
+/* Record modified header bytes */
+void fw_image_dirty ( struct fw_image *image, size_t off, size_t len )
+{
+    if ( image->dirty_start == FW_TO_END || off < image->dirty_start )
+    {
+        image->dirty_start = off;
+    }
+
+    if ( off + len > image->dirty_end )
+    {
+        image->dirty_end = off + len;
+    }
+}
+
+/* Write bytes over image range, durably, previous ones are kept in old */
+int fw_image_patch ( struct fw_image *image, size_t off, const unsigned char *buf,
+    size_t len, unsigned char *old )
+{
+    size_t start;
+    size_t size = fw_image_size ( image );
+    size_t page = sysconf ( _SC_PAGESIZE );
+
+    if ( image->readonly || size == FW_TO_END || off > size || len > size - off )
+    {
+        fprintf ( stderr, "Error: patch is out of range\n" );
+        return -1;
+    }
+
+    if ( image->mode == FW_IMAGE_MAPPED )
+    {
+        memcpy ( old, image->header + off, len );
+        memcpy ( image->header + off, buf, len );
+
+        start = ( image->offset + off ) & ~( page - 1 );
+        if ( msync ( ( void * ) ( image->pmaddr + start ), image->offset + off + len - start,
+                MS_SYNC ) < 0 )
+        {
+            perror ( "msync" );
+            return -1;
+        }
+
+        /* keep block index in step, streamed images have none */
+        fw_index_dirty ( image, off, len );
+        return 0;
+    }
+
+    if ( fw_image_read ( image, old, off, len ) != ( ssize_t ) len )
+    {
+        fprintf ( stderr, "Error: patch is out of range\n" );
+        return -1;
+    }
+
+    if ( pwrite ( image->fd, buf, len, image->offset + off ) != ( ssize_t ) len )
+    {
+        perror ( "pwrite" );
+        return -1;
+    }
+
+    if ( fdatasync ( image->fd ) < 0 )
+    {
+        perror ( "fdatasync" );
+        return -1;
+    }
+
+    /* buffered header has to show the patched bytes too */
+    if ( off < image->header_len )
+    {
+        memcpy ( image->header + off, buf,
+            len < image->header_len - off ? len : image->header_len - off );
+    }
+
+    return 0;
+}
+
+/* Flush modified header bytes to file */
+static int fw_image_writeback ( struct fw_image *image )
+{
+    size_t len;
+    size_t start;
+    size_t page = sysconf ( _SC_PAGESIZE );
+
+    if ( image->dirty_start == FW_TO_END )
+    {
+        return 0;
+    }
+
+    if ( image->mode == FW_IMAGE_MAPPED )
+    {
+        /*
+         * The above stores may or may not be sitting in cache at
+         * this point, depending on other system activity causing
+         * cache pressure.  Force the change to be durable (flushed
+         * all the say to the Persistent Memory) using msync().
+         * Only the pages holding modified header bytes are synced.
+         */
+        start = ( image->offset + image->dirty_start ) & ~( page - 1 );
+        len = image->offset + image->dirty_end - start;
+
+        if ( msync ( ( void * ) ( image->pmaddr + start ), len, MS_SYNC ) < 0 )
+        {
+            perror ( "msync" );
+            return -1;
+        }
+
+    } else
+    {
+        /* buffered header has to be written back explicitly */
+        len = image->dirty_end - image->dirty_start;
+
+        if ( pwrite ( image->fd, image->header + image->dirty_start, len,
+                image->offset + image->dirty_start ) != ( ssize_t ) len )
+        {
+            perror ( "pwrite" );
+            return -1;
+        }
+
+        if ( fdatasync ( image->fd ) < 0 )
+        {
+            perror ( "fdatasync" );
+            return -1;
+        }
+    }
+
+    image->dirty_start = FW_TO_END;
+    image->dirty_end = 0;
+
+    return 0;
+}
+
+/* Write modified header bytes back to file */
+int fw_image_sync ( struct fw_image *image )
+{
+    int status;
+    size_t start = image->dirty_start;
+    size_t len = start == FW_TO_END ? 0 : image->dirty_end - start;
+    struct fw_stats_mark mark;
+
+    fw_stats_begin ( &mark );
+    status = fw_image_writeback ( image );
+    fw_stats_end ( &mark, FW_PHASE_SYNC, len );
+
+    /* keep block index in step with the synced header */
+    if ( !status && len )
+    {
+        fw_index_dirty ( image, start, len );
+    }
+
+    return status;
+}
@@ -0,0 +1,611 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Block Crc32 Index
+ * ------------------------------------------------------------------ */
+
+#include <time.h>
+
+#include "fwutils.h"
+
+/*
+ * The sidecar file next to an image keeps crc32buf of every block
+ * of FW_INDEX_BLOCK bytes, counted from the header. Checksum of any
+ * range is then combined from the blocks it covers, only the bytes
+ * of partly covered blocks at its ends are hashed. The index belongs
+ * to the file size and mtime seen when it was opened. Those tell nothing
+ * of which blocks another writer changed, so the whole index is rebuilt
+ * on the image threads whenever either differs, and an index whose file
+ * changed under it is dropped at close. Blocks written by this library
+ * are rehashed in place once synced, the key moves on with them. Words
+ * are in host order.
+ *
+ * The md5 sidecar keeps midstates of a stream taken every
+ * FW_CHECKPOINT_INTERVAL bytes, each with crc32 of the segment before
+ * it. Unchanged segments are found by their crc32, combined from the
+ * block index, and md5 resumes from the last checkpoint before the
+ * first one changed. Its words are little-endian.
+ */
+
+#define FW_INDEX_MAGIC "FWCRCIX1"
+#define FW_INDEX_SUFFIX ".crcidx"
+#define FW_INDEX_BLOCK (1 << 20)
+#define FW_INDEX_MAX_THREADS 256
+#define FW_INDEX_RACY 2000000000ULL     /* ns, mtime coarser than this is trusted */
+#define FW_INDEX_TICK 20000000ULL       /* ns, the same for sub-second mtime */
+
+#define FW_CHECKPOINT_MAGIC "FWMD5IX1"
+#define FW_CHECKPOINT_SUFFIX ".md5idx"
+#define FW_CHECKPOINT_INTERVAL (4 << 20)        /* multiple of FW_INDEX_BLOCK */
+#define FW_CHECKPOINT_HEAD 64   /* magic, interval, offset, start, midstate, count */
+#define FW_CHECKPOINT_ENTRY (MD5_STATE_SIZE + 8)        /* midstate, segment crc32 */
+
+/* Sidecar file header, block checksums follow */
+struct fw_index_head
+{
+    char magic[8];
+    uint64_t block;
+    uint64_t offset;            /* header offset from file beginning */
+    uint64_t size;              /* file size */
+    uint64_t mtime_ns;
+    uint64_t written_ns;        /* blocks were hashed no earlier than this */
+    uint64_t count;
+};
+
+/* Block checksums of an open image */
+struct fw_index
+{
+    char *file;                 /* image file, sidecars are named after it */
+    struct fw_index_head head;
+    uint32_t *crc;
+    int valid;                  /* checksums match the image */
+    int changed;                /* to be written out on close */
+};
+
+/* Parallel block job description */
+struct fw_index_job
+{
+    pthread_t thread;
+    const struct fw_image *image;
+    unsigned int first;         /* every step-th block from first on */
+    unsigned int step;
+    struct fw_stats_mark *stats;        /* phase that started the job, NULL if none */
+};
+
+/* Get wall clock reading in nanoseconds */
+static uint64_t fw_index_now ( void )
+{
+    struct timespec ts;
+
+    clock_gettime ( CLOCK_REALTIME, &ts );
+    return ( uint64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Get time past mtime after which a write would have changed it */
+static uint64_t fw_index_racy ( uint64_t mtime_ns )
+{
+    /* whole seconds hint at a file system keeping no more than that */
+    return mtime_ns % 1000000000 ? FW_INDEX_TICK : FW_INDEX_RACY;
+}
+
+/* Fill key fields of header from the open file */
+static int fw_index_key ( const struct fw_image *image, struct fw_index_head *head )
+{
+    struct stat st;
+
+    if ( fstat ( image->fd, &st ) < 0 )
+    {
+        perror ( "fstat" );
+        return -1;
+    }
+
+    memset ( head, '\0', sizeof ( struct fw_index_head ) );
+    memcpy ( head->magic, FW_INDEX_MAGIC, sizeof ( head->magic ) );
+    head->block = FW_INDEX_BLOCK;
+    head->offset = image->offset;
+    head->size = st.st_size;
+    head->mtime_ns = ( uint64_t ) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    head->count = ( image->header_len + FW_INDEX_BLOCK - 1 ) / FW_INDEX_BLOCK;
+
+    return 0;
+}
+
+/* Get key of the file as it is now, blocks hashed from the time stamped on are covered */
+static int fw_index_seen ( const struct fw_image *image, struct fw_index_head *head )
+{
+    uint64_t now;
+    uint64_t trusted;
+    struct timespec ts;
+
+    if ( fw_index_key ( image, head ) < 0 )
+    {
+        return -1;
+    }
+
+    /* right after a write, wait out a short racy window */
+    now = fw_index_now (  );
+    trusted = head->mtime_ns + fw_index_racy ( head->mtime_ns );
+    if ( now < trusted && trusted - now <= FW_INDEX_TICK )
+    {
+        ts.tv_sec = 0;
+        ts.tv_nsec = trusted - now;
+        nanosleep ( &ts, NULL );
+        now = fw_index_now (  );
+    }
+
+    head->written_ns = now;
+    return 0;
+}
+
+/* Load sidecar if it still describes the image */
+static void fw_index_load ( struct fw_index *index )
+{
+    int fd;
+    size_t len;
+    struct fw_index_head head;
+    char path[4096];
+
+    snprintf ( path, sizeof ( path ), "%s%s", index->file, FW_INDEX_SUFFIX );
+
+    if ( ( fd = open ( path, O_RDONLY ) ) < 0 )
+    {
+        return;
+    }
+
+    len = index->head.count * sizeof ( uint32_t );
+
+    /* a write within the same mtime tick as the sidecar would go unnoticed */
+    if ( read ( fd, &head, sizeof ( head ) ) == sizeof ( head )
+        && !memcmp ( &head, &index->head, offsetof ( struct fw_index_head, written_ns ) )
+        && head.count == index->head.count
+        && head.mtime_ns + fw_index_racy ( head.mtime_ns ) <= head.written_ns
+        && read ( fd, index->crc, len ) == ( ssize_t ) len )
+    {
+        index->valid = TRUE;
+    }
+
+    close ( fd );
+}
+
+/* Write sidecar of image file out, replacing the old one at once */
+static int fw_index_write ( const struct fw_index *index, const char *suffix,
+    const void *head, size_t head_len, const void *data, size_t len )
+{
+    int fd;
+    char path[4096];
+    char tmp[4096];
+
+    snprintf ( path, sizeof ( path ), "%s%s", index->file, suffix );
+    snprintf ( tmp, sizeof ( tmp ), "%s%s.tmp", index->file, suffix );
+
+    if ( ( fd = open ( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644 ) ) < 0 )
+    {
+        perror ( tmp );
+        return -1;
+    }
+
+    if ( write ( fd, head, head_len ) != ( ssize_t ) head_len
+        || write ( fd, data, len ) != ( ssize_t ) len )
+    {
+        perror ( "write" );
+        close ( fd );
+        unlink ( tmp );
+        return -1;
+    }
+
+    close ( fd );
+
+    if ( rename ( tmp, path ) < 0 )
+    {
+        perror ( "rename" );
+        unlink ( tmp );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Attach block index of image file, loaded from its sidecar when still valid */
+int fw_index_open ( struct fw_image *image, const char *path )
+{
+    struct fw_index *index;
+
+    /* ranges are combined from mapped blocks only */
+    if ( image->mode != FW_IMAGE_MAPPED || !strcmp ( path, "-" ) )
+    {
+        return 0;
+    }
+
+    if ( !( index = ( struct fw_index * ) calloc ( 1, sizeof ( struct fw_index ) ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( fw_index_seen ( image, &index->head ) < 0 )
+    {
+        free ( index );
+        return -1;
+    }
+
+    if ( !( index->file = strdup ( path ) )
+        || !( index->crc = ( uint32_t * ) calloc ( index->head.count + 1,
+                sizeof ( uint32_t ) ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        free ( index->file );
+        free ( index );
+        return -1;
+    }
+
+    fw_index_load ( index );
+    image->index = index;
+
+    return 0;
+}
+
+/* Detach block index, its sidecar is written if it was rebuilt */
+void fw_index_close ( struct fw_image *image )
+{
+    struct fw_index_head head;
+    struct fw_index *index = image->index;
+    char path[4096];
+
+    if ( !index )
+    {
+        return;
+    }
+
+    /* another writer since may have changed blocks hashed before */
+    if ( index->changed && ( fw_index_key ( image, &head ) < 0
+            || memcmp ( &head, &index->head, offsetof ( struct fw_index_head, written_ns ) ) ) )
+    {
+        snprintf ( path, sizeof ( path ), "%s%s", index->file, FW_INDEX_SUFFIX );
+        unlink ( path );
+
+    } else if ( index->changed )
+    {
+        fw_index_write ( index, FW_INDEX_SUFFIX, &index->head, sizeof ( index->head ),
+            index->crc, index->head.count * sizeof ( uint32_t ) );
+    }
+
+    free ( index->crc );
+    free ( index->file );
+    free ( index );
+    image->index = NULL;
+}
+
+/* Get length of block */
+static size_t fw_index_len ( const struct fw_image *image, size_t block )
+{
+    size_t off = block * FW_INDEX_BLOCK;
+
+    return image->header_len - off < FW_INDEX_BLOCK ? image->header_len - off : FW_INDEX_BLOCK;
+}
+
+/* Block job thread, hashes every step-th block */
+static void *fw_index_job_run ( void *arg )
+{
+    size_t i;
+    struct fw_index_job *job = ( struct fw_index_job * ) arg;
+    const struct fw_image *image = job->image;
+
+    for ( i = job->first; i < image->index->head.count; i += job->step )
+    {
+        image->index->crc[i] = crc32buf ( image->header + i * FW_INDEX_BLOCK,
+            fw_index_len ( image, i ) );
+    }
+
+    return NULL;
+}
+
+/* Block job started on its own thread, accounted to the phase */
+static void *fw_index_job_thread ( void *arg )
+{
+    struct fw_index_job *job = ( struct fw_index_job * ) arg;
+
+    fw_index_job_run ( job );
+    fw_stats_thread ( job->stats );
+
+    return NULL;
+}
+
+/* Hash every block of image on threads */
+static void fw_index_build ( const struct fw_image *image, unsigned int threads )
+{
+    unsigned int i;
+    unsigned int started;
+    struct fw_stats_mark *stats = fw_stats_current (  );
+    struct fw_index_job job[FW_INDEX_MAX_THREADS];
+
+    if ( threads > FW_INDEX_MAX_THREADS )
+    {
+        threads = FW_INDEX_MAX_THREADS;
+    }
+
+    if ( threads > image->index->head.count )
+    {
+        threads = image->index->head.count;
+    }
+
+    /* the calling thread takes the first share */
+    for ( started = 1; started < threads; started++ )
+    {
+        job[started].image = image;
+        job[started].first = started;
+        job[started].step = threads;
+        job[started].stats = stats;
+        if ( pthread_create ( &job[started].thread, NULL, fw_index_job_thread, &job[started] ) )
+        {
+            break;
+        }
+    }
+
+    /* blocks of threads that failed to start are taken as well */
+    job[0].image = image;
+    job[0].step = threads;
+    for ( i = 0; i < threads; i++ )
+    {
+        if ( !i || i >= started )
+        {
+            job[0].first = i;
+            fw_index_job_run ( &job[0] );
+        }
+    }
+
+    for ( i = 1; i < started; i++ )
+    {
+        pthread_join ( job[i].thread, NULL );
+    }
+
+    image->index->valid = TRUE;
+    image->index->changed = TRUE;
+}
+
+/* Combine crc32 checksum of image range from blocks, hashed bytes are added up */
+int fw_index_crc32 ( struct fw_image *image, size_t off, size_t len, unsigned int threads,
+    uint32_t * crc, size_t *hashed )
+{
+    int first = TRUE;
+    size_t i;
+    size_t end;
+    size_t next;
+    size_t size = image->header_len;
+    uint32_t part;
+
+    if ( len == FW_TO_END )
+    {
+        len = off <= size ? size - off : 0;
+    }
+
+    if ( off > size || len > size - off )
+    {
+        fprintf ( stderr, "Error: image data out of range\n" );
+        return -1;
+    }
+
+    if ( !image->index->valid )
+    {
+        fw_index_build ( image, threads ? threads : 1 );
+        *hashed += size;
+    }
+
+    *crc = 0xFFFFFFFF;
+
+    for ( end = off + len; off < end; off = next )
+    {
+        i = off / FW_INDEX_BLOCK;
+        next = i * FW_INDEX_BLOCK + fw_index_len ( image, i );
+
+        /* whole blocks are taken from the index, parts are hashed */
+        if ( off == i * FW_INDEX_BLOCK && next <= end )
+        {
+            part = image->index->crc[i];
+
+        } else
+        {
+            next = next < end ? next : end;
+            part = crc32buf ( image->header + off, next - off );
+            *hashed += next - off;
+        }
+
+        *crc = first ? part : crc32_combine ( *crc, part, next - off );
+        first = FALSE;
+    }
+
+    return 0;
+}
+
+/* Rehash blocks holding header bytes just written and synced */
+void fw_index_dirty ( struct fw_image *image, size_t off, size_t len )
+{
+    size_t i;
+
+    if ( !image->index || !len )
+    {
+        return;
+    }
+
+    /* the file changed by our own write, the index follows it */
+    if ( fw_index_seen ( image, &image->index->head ) < 0 )
+    {
+        image->index->valid = FALSE;
+        image->index->changed = FALSE;
+        return;
+    }
+
+    if ( !image->index->valid )
+    {
+        return;
+    }
+
+    for ( i = off / FW_INDEX_BLOCK; i <= ( off + len - 1 ) / FW_INDEX_BLOCK; i++ )
+    {
+        image->index->crc[i] = crc32buf ( image->header + i * FW_INDEX_BLOCK,
+            fw_index_len ( image, i ) );
+    }
+
+    image->index->changed = TRUE;
+}
+
+/* Store 64-bit word little-endian */
+static void fw_index_put64 ( unsigned char *p, uint64_t value )
+{
+    unsigned int i;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        p[i] = ( unsigned char ) ( value >> ( 8 * i ) );
+    }
+}
+
+/* Load little-endian 64-bit word */
+static uint64_t fw_index_get64 ( const unsigned char *p )
+{
+    unsigned int i;
+    uint64_t value = 0;
+
+    for ( i = 0; i < 8; i++ )
+    {
+        value |= ( uint64_t ) p[i] << ( 8 * i );
+    }
+
+    return value;
+}
+
+/* Store md5 sidecar header of stream started at off */
+static void fw_checkpoint_head ( const struct fw_image *image, size_t off,
+    const MD5_STATE * start, size_t count, unsigned char head[FW_CHECKPOINT_HEAD] )
+{
+    memset ( head, '\0', FW_CHECKPOINT_HEAD );
+    memcpy ( head, FW_CHECKPOINT_MAGIC, 8 );
+    fw_index_put64 ( head + 8, FW_CHECKPOINT_INTERVAL );
+    fw_index_put64 ( head + 16, image->offset );
+    fw_index_put64 ( head + 24, off );
+    MD5_Serialize ( start, head + 32 );
+    fw_index_put64 ( head + 56, count );
+}
+
+/* Load checkpoints of the same stream start from md5 sidecar, get their count */
+static size_t fw_checkpoint_load ( const struct fw_index *index, const unsigned char *want,
+    unsigned char *entries, size_t count )
+{
+    int fd;
+    size_t len;
+    size_t stored;
+    unsigned char head[FW_CHECKPOINT_HEAD];
+    char path[4096];
+
+    snprintf ( path, sizeof ( path ), "%s%s", index->file, FW_CHECKPOINT_SUFFIX );
+
+    if ( ( fd = open ( path, O_RDONLY ) ) < 0 )
+    {
+        return 0;
+    }
+
+    /* everything up to the checkpoint count has to match */
+    if ( read ( fd, head, sizeof ( head ) ) != sizeof ( head ) || memcmp ( head, want, 56 ) )
+    {
+        close ( fd );
+        return 0;
+    }
+
+    stored = fw_index_get64 ( head + 56 );
+    stored = stored < count ? stored : count;
+    len = stored * FW_CHECKPOINT_ENTRY;
+
+    if ( read ( fd, entries, len ) != ( ssize_t ) len )
+    {
+        stored = 0;
+    }
+
+    close ( fd );
+    return stored;
+}
+
+/* Feed image from off to end into md5 context, resuming the last unchanged checkpoint */
+int fw_index_md5 ( struct fw_image *image, size_t off, MD5_CTX * ctx, size_t *hashed )
+{
+    size_t k;
+    size_t pos;
+    size_t next;
+    size_t count;
+    size_t resumed;
+    size_t size = image->header_len;
+    uint32_t crc;
+    MD5_STATE state;
+    unsigned char head[FW_CHECKPOINT_HEAD];
+    unsigned char *entries;
+    unsigned char *entry;
+
+    if ( off > size )
+    {
+        fprintf ( stderr, "Error: image data out of range\n" );
+        return -1;
+    }
+
+    count = size / FW_CHECKPOINT_INTERVAL;
+
+    /* checkpoints need a stream of whole blocks started right before off */
+    if ( MD5_Save ( ctx, &state ) < 0 || state.i[0] != ( UINT4 ) ( ( uint64_t ) off << 3 )
+        || state.i[1] != ( UINT4 ) ( ( uint64_t ) off >> 29 )
+        || off >= FW_CHECKPOINT_INTERVAL || !count
+        || !( entries = ( unsigned char * ) malloc ( count * FW_CHECKPOINT_ENTRY ) ) )
+    {
+        MD5_Update ( ctx, image->header + off, size - off );
+        *hashed += size - off;
+        return 0;
+    }
+
+    fw_checkpoint_head ( image, off, &state, count, head );
+    resumed = fw_checkpoint_load ( image->index, head, entries, count );
+
+    /* segment before a checkpoint has to hash the same as when it was taken */
+    for ( k = 0; k < resumed; k++ )
+    {
+        pos = k ? k * FW_CHECKPOINT_INTERVAL : off;
+        entry = entries + k * FW_CHECKPOINT_ENTRY;
+        if ( fw_index_crc32 ( image, pos, ( k + 1 ) * FW_CHECKPOINT_INTERVAL - pos, 1, &crc,
+                hashed ) < 0 || crc != fw_index_get64 ( entry + MD5_STATE_SIZE ) )
+        {
+            break;
+        }
+    }
+
+    resumed = k;
+    pos = off;
+
+    if ( resumed )
+    {
+        MD5_Deserialize ( &state, entries + ( resumed - 1 ) * FW_CHECKPOINT_ENTRY );
+        MD5_Restore ( ctx, &state );
+        pos = resumed * FW_CHECKPOINT_INTERVAL;
+    }
+
+    /* hash the rest one segment at a time, taking checkpoints on the way */
+    for ( ; pos < size; pos = next )
+    {
+        next = ( pos / FW_CHECKPOINT_INTERVAL + 1 ) * FW_CHECKPOINT_INTERVAL;
+        next = next < size ? next : size;
+
+        MD5_Update ( ctx, image->header + pos, next - pos );
+        *hashed += next - pos;
+
+        if ( !( next % FW_CHECKPOINT_INTERVAL ) )
+        {
+            k = next / FW_CHECKPOINT_INTERVAL - 1;
+            entry = entries + k * FW_CHECKPOINT_ENTRY;
+            crc = crc32buf ( image->header + pos, next - pos );
+            MD5_Save ( ctx, &state );
+            MD5_Serialize ( &state, entry );
+            fw_index_put64 ( entry + MD5_STATE_SIZE, crc );
+        }
+    }
+
+    if ( resumed < count )
+    {
+        fw_index_write ( image->index, FW_CHECKPOINT_SUFFIX, head, sizeof ( head ), entries,
+            count * FW_CHECKPOINT_ENTRY );
+    }
+
+    free ( entries );
+    return 0;
+}
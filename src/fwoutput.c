@@ -0,0 +1,400 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Result Output
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+/* Output format names, indexed by FW_OUTPUT_* */
+static const char *fw_output_names[] = {
+    "text",
+    "json",
+    "csv",
+    "tsv"
+};
+
+/* Column names of csv and tsv rows */
+static const char *fw_output_columns[] = {
+    "path",
+    "format",
+    "offset",
+    "size",
+    "status",
+    "checksum",
+    "stored",
+    "computed",
+    "checksum_status"
+};
+
+/* Prepare record of a file to be verified */
+void fw_record_init ( struct fw_record *record, const struct fw_format *format,
+    const struct fw_options *options, const char *path )
+{
+    memset ( record, '\0', sizeof ( struct fw_record ) );
+    record->path = path;
+    record->format = format == &fw_format_auto ? NULL : format->name;
+    record->offset = options->offset;
+    record->result = FW_RESULT_ERROR;
+}
+
+/* Add checksum pair to record */
+static void fw_record_add ( struct fw_record *record, const char *name,
+    const unsigned char *stored, const unsigned char *computed, unsigned int len )
+{
+    struct fw_check *check;
+
+    if ( record->count >= FW_CHECKS_MAX )
+    {
+        return;
+    }
+
+    check = &record->check[record->count++];
+    snprintf ( check->name, sizeof ( check->name ), "%s", name );
+    check->len = len;
+    memcpy ( check->stored, stored, len );
+    memcpy ( check->computed, computed, len );
+}
+
+/* Record crc32 stored in a header and the one computed */
+void fw_record_crc32 ( struct fw_record *record, const char *name, uint32_t stored,
+    uint32_t computed )
+{
+    unsigned int i;
+    unsigned char s[4];
+    unsigned char c[4];
+
+    /* most significant byte first, hex reads as the number */
+    for ( i = 0; i < 4; i++ )
+    {
+        s[i] = stored >> ( 24 - 8 * i );
+        c[i] = computed >> ( 24 - 8 * i );
+    }
+
+    fw_record_add ( record, name, s, c, 4 );
+}
+
+/* Record md5 stored in a header and the one computed */
+void fw_record_md5 ( struct fw_record *record, const char *name,
+    const unsigned char *stored, const unsigned char *computed )
+{
+    fw_record_add ( record, name, stored, computed, 16 );
+}
+
+/* Get output format by name, -1 if unknown */
+int fw_output_parse ( const char *name )
+{
+    unsigned int i;
+
+    for ( i = 0; i < sizeof ( fw_output_names ) / sizeof ( fw_output_names[0] ); i++ )
+    {
+        if ( !strcmp ( name, fw_output_names[i] ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Append string, room has been reserved */
+static void fw_output_str ( struct fw_output *output, const char *str )
+{
+    size_t len = strlen ( str );
+
+    memcpy ( output->buf + output->len, str, len );
+    output->len += len;
+}
+
+/* Append character, room has been reserved */
+static void fw_output_char ( struct fw_output *output, char c )
+{
+    output->buf[output->len++] = c;
+}
+
+/* Append unsigned number, room has been reserved */
+static void fw_output_num ( struct fw_output *output, unsigned long value )
+{
+    output->len += sprintf ( output->buf + output->len, "%lu", value );
+}
+
+/* Append bytes as hex, room has been reserved */
+static void fw_output_hex ( struct fw_output *output, const unsigned char *buf, size_t len )
+{
+    size_t i;
+    static const char digits[] = "0123456789abcdef";
+
+    for ( i = 0; i < len; i++ )
+    {
+        fw_output_char ( output, digits[buf[i] >> 4] );
+        fw_output_char ( output, digits[buf[i] & 15] );
+    }
+}
+
+/* Append string escaped as a field of current output format */
+static void fw_output_field ( struct fw_output *output, const char *str )
+{
+    const char *p;
+
+    if ( output->format == FW_OUTPUT_JSON )
+    {
+        fw_output_char ( output, '"' );
+        for ( p = str; *p; p++ )
+        {
+            if ( *p == '"' || *p == '\\' )
+            {
+                fw_output_char ( output, '\\' );
+                fw_output_char ( output, *p );
+
+            } else if ( ( unsigned char ) *p < 0x20 )
+            {
+                output->len += sprintf ( output->buf + output->len, "\\u%.4x",
+                    ( unsigned char ) *p );
+            } else
+            {
+                fw_output_char ( output, *p );
+            }
+        }
+        fw_output_char ( output, '"' );
+
+    } else if ( output->format == FW_OUTPUT_CSV )
+    {
+        /* quote only when needed, quotes are doubled */
+        if ( !strpbrk ( str, ",\"\r\n" ) )
+        {
+            fw_output_str ( output, str );
+            return;
+        }
+
+        fw_output_char ( output, '"' );
+        for ( p = str; *p; p++ )
+        {
+            if ( *p == '"' )
+            {
+                fw_output_char ( output, '"' );
+            }
+            fw_output_char ( output, *p );
+        }
+        fw_output_char ( output, '"' );
+
+    } else if ( output->format == FW_OUTPUT_TSV )
+    {
+        for ( p = str; *p; p++ )
+        {
+            switch ( *p )
+            {
+            case '\t':
+                fw_output_str ( output, "\\t" );
+                break;
+            case '\n':
+                fw_output_str ( output, "\\n" );
+                break;
+            case '\r':
+                fw_output_str ( output, "\\r" );
+                break;
+            case '\\':
+                fw_output_str ( output, "\\\\" );
+                break;
+            default:
+                fw_output_char ( output, *p );
+            }
+        }
+
+    } else
+    {
+        fw_output_str ( output, str );
+    }
+}
+
+/* Append one csv or tsv row, check may be NULL */
+static void fw_output_row ( struct fw_output *output, const struct fw_record *record,
+    const struct fw_check *check )
+{
+    char sep = output->format == FW_OUTPUT_CSV ? ',' : '\t';
+
+    fw_output_field ( output, record->path );
+    fw_output_char ( output, sep );
+    fw_output_field ( output, record->format ? record->format : "" );
+    fw_output_char ( output, sep );
+    fw_output_num ( output, record->offset );
+    fw_output_char ( output, sep );
+    fw_output_num ( output, record->size );
+    fw_output_char ( output, sep );
+    fw_output_str ( output, fw_result_names[record->result] );
+    fw_output_char ( output, sep );
+
+    if ( check )
+    {
+        fw_output_field ( output, check->name );
+        fw_output_char ( output, sep );
+        fw_output_hex ( output, check->stored, check->len );
+        fw_output_char ( output, sep );
+        fw_output_hex ( output, check->computed, check->len );
+        fw_output_char ( output, sep );
+        fw_output_str ( output, fw_result_names[memcmp ( check->stored, check->computed,
+                    check->len ) ? FW_RESULT_INCORRECT : FW_RESULT_CORRECT] );
+    } else
+    {
+        fw_output_char ( output, sep );
+        fw_output_char ( output, sep );
+        fw_output_char ( output, sep );
+    }
+
+    fw_output_char ( output, '\n' );
+}
+
+/* Append record as one json object */
+static void fw_output_json ( struct fw_output *output, const struct fw_record *record )
+{
+    unsigned int i;
+    const struct fw_check *check;
+
+    fw_output_str ( output, "{\"path\":" );
+    fw_output_field ( output, record->path );
+    fw_output_str ( output, ",\"format\":" );
+    if ( record->format )
+    {
+        fw_output_field ( output, record->format );
+    } else
+    {
+        fw_output_str ( output, "null" );
+    }
+    fw_output_str ( output, ",\"offset\":" );
+    fw_output_num ( output, record->offset );
+    fw_output_str ( output, ",\"size\":" );
+    fw_output_num ( output, record->size );
+    fw_output_str ( output, ",\"status\":\"" );
+    fw_output_str ( output, fw_result_names[record->result] );
+    fw_output_str ( output, "\",\"checksums\":[" );
+
+    for ( i = 0; i < record->count; i++ )
+    {
+        check = &record->check[i];
+        fw_output_str ( output, i ? ",{\"name\":" : "{\"name\":" );
+        fw_output_field ( output, check->name );
+        fw_output_str ( output, ",\"stored\":\"" );
+        fw_output_hex ( output, check->stored, check->len );
+        fw_output_str ( output, "\",\"computed\":\"" );
+        fw_output_hex ( output, check->computed, check->len );
+        fw_output_str ( output, "\",\"status\":\"" );
+        fw_output_str ( output, fw_result_names[memcmp ( check->stored, check->computed,
+                    check->len ) ? FW_RESULT_INCORRECT : FW_RESULT_CORRECT] );
+        fw_output_str ( output, "\"}" );
+    }
+
+    fw_output_str ( output, "]}\n" );
+}
+
+/* Allocate output buffer, csv and tsv start with a header row */
+int fw_output_init ( struct fw_output *output, int format )
+{
+    unsigned int i;
+
+    output->format = format;
+    output->len = 0;
+    output->size = FW_OUTPUT_SIZE;
+
+    if ( !( output->buf = ( char * ) malloc ( output->size ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( format == FW_OUTPUT_CSV || format == FW_OUTPUT_TSV )
+    {
+        for ( i = 0; i < sizeof ( fw_output_columns ) / sizeof ( fw_output_columns[0] ); i++ )
+        {
+            if ( i )
+            {
+                fw_output_char ( output, format == FW_OUTPUT_CSV ? ',' : '\t' );
+            }
+            fw_output_str ( output, fw_output_columns[i] );
+        }
+        fw_output_char ( output, '\n' );
+    }
+
+    return 0;
+}
+
+/* Append serialized record, flush first if it might not fit */
+int fw_output_record ( struct fw_output *output, const struct fw_record *record )
+{
+    unsigned int i;
+    char *grown;
+    size_t need;
+
+    /* every row repeats the path, escaping grows it up to six times */
+    need = ( FW_CHECKS_MAX + 1 ) * ( 6 * strlen ( record->path ) + 256 );
+
+    if ( output->len + need > output->size && fw_output_flush ( output ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( need > output->size )
+    {
+        if ( !( grown = ( char * ) realloc ( output->buf, need ) ) )
+        {
+            fprintf ( stderr, "Error: out of memory\n" );
+            return -1;
+        }
+        output->buf = grown;
+        output->size = need;
+    }
+
+    switch ( output->format )
+    {
+    case FW_OUTPUT_JSON:
+        fw_output_json ( output, record );
+        break;
+    case FW_OUTPUT_CSV:
+    case FW_OUTPUT_TSV:
+        fw_output_row ( output, record, record->count ? &record->check[0] : NULL );
+        for ( i = 1; i < record->count; i++ )
+        {
+            fw_output_row ( output, record, &record->check[i] );
+        }
+        break;
+    default:
+        fw_output_str ( output, record->path );
+        fw_output_str ( output, " : " );
+        fw_output_str ( output, fw_result_names[record->result] );
+        fw_output_char ( output, '\n' );
+    }
+
+    return 0;
+}
+
+/* Write buffered output out at once */
+int fw_output_flush ( struct fw_output *output )
+{
+    ssize_t ret;
+    size_t done = 0;
+
+    while ( done < output->len )
+    {
+        if ( ( ret = write ( STDOUT_FILENO, output->buf + done, output->len - done ) ) < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            perror ( "write" );
+            output->len = 0;
+            return -1;
+        }
+
+        done += ret;
+    }
+
+    output->len = 0;
+    return 0;
+}
+
+/* Flush and release output buffer */
+int fw_output_free ( struct fw_output *output )
+{
+    int status = fw_output_flush ( output );
+
+    free ( output->buf );
+    output->buf = NULL;
+    return status;
+}
@@ -0,0 +1,368 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Embedded Header Scanner
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+#include "binhdr.h"
+
+#define FW_MAGIC_LEN 4
+
+/* Magic bytes found at a fixed offset within a format header */
+struct fw_magic
+{
+    const struct fw_format *format;
+    size_t off;
+    unsigned char bytes[FW_MAGIC_LEN];
+};
+
+/* TP-Link has no magic, its version word is accepted in both byte orders */
+static const struct fw_magic fw_magics[] = {
+    {&fw_format_trx, 0, {'H', 'D', 'R', '0'}},
+    {&fw_format_bcm, 0, {0x36, 0x00, 0x00, 0x00}},
+    {&fw_format_binhdr, offsetof ( struct bin_header, ID ), {'U', '2', 'N', 'D'}},
+    {&fw_format_tplink, 0, {0x00, 0x00, 0x00, 0x01}},
+    {&fw_format_tplink, 0, {0x00, 0x00, 0x00, 0x02}},
+    {&fw_format_tplink, 0, {0x01, 0x00, 0x00, 0x00}},
+    {&fw_format_tplink, 0, {0x02, 0x00, 0x00, 0x00}}
+};
+
+#define FW_MAGICS (sizeof ( fw_magics ) / sizeof ( fw_magics[0] ))
+
+/* Scan state shared with the walk and hit consumers */
+struct fw_scan_state
+{
+    const struct fw_format *format;
+    const struct fw_options *options;
+    struct fw_image *image;
+    const char *path;
+    struct fw_output *output;
+    size_t base;                /* header offset of the buffer being scanned */
+    unsigned int found;
+    int error;
+};
+
+/* Bytes some magic starts with */
+static unsigned char fw_scan_first[256];
+
+typedef void ( *fw_scan_kernel_t ) ( const unsigned char *buf, size_t len, fw_hit_t fn,
+    void *arg );
+
+/* Report position if a magic starts there */
+static void fw_scan_check ( const unsigned char *buf, size_t pos, fw_hit_t fn, void *arg )
+{
+    unsigned int i;
+
+    for ( i = 0; i < FW_MAGICS; i++ )
+    {
+        if ( !memcmp ( buf + pos, fw_magics[i].bytes, FW_MAGIC_LEN ) )
+        {
+            fn ( arg, pos );
+            return;
+        }
+    }
+}
+
+/* Check every position from pos on whose byte starts some magic */
+static void fw_scan_range ( const unsigned char *buf, size_t pos, size_t len, fw_hit_t fn,
+    void *arg )
+{
+    for ( ; pos + FW_MAGIC_LEN <= len; pos++ )
+    {
+        if ( fw_scan_first[buf[pos]] )
+        {
+            fw_scan_check ( buf, pos, fn, arg );
+        }
+    }
+}
+
+/* Check positions one by one */
+static void fw_scan_scalar ( const unsigned char *buf, size_t len, fw_hit_t fn, void *arg )
+{
+    fw_scan_range ( buf, 0, len, fn, arg );
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+/*
+ * Candidates have both the first and the last magic byte in place,
+ * 16 or 32 positions are filtered at once and only the survivors
+ * are compared in full.
+ */
+
+/* Sixteen positions at once with SSE2 */
+__attribute__ ( ( target ( "sse2" ) ) )
+static void fw_scan_sse2 ( const unsigned char *buf, size_t len, fw_hit_t fn, void *arg )
+{
+    unsigned int i;
+    unsigned int mask;
+    size_t pos;
+    __m128i first[FW_MAGICS];
+    __m128i last[FW_MAGICS];
+    __m128i head, tail, hits;
+
+    for ( i = 0; i < FW_MAGICS; i++ )
+    {
+        first[i] = _mm_set1_epi8 ( fw_magics[i].bytes[0] );
+        last[i] = _mm_set1_epi8 ( fw_magics[i].bytes[FW_MAGIC_LEN - 1] );
+    }
+
+    for ( pos = 0; pos + 16 + FW_MAGIC_LEN - 1 <= len; pos += 16 )
+    {
+        head = _mm_loadu_si128 ( ( const __m128i * ) ( buf + pos ) );
+        tail = _mm_loadu_si128 ( ( const __m128i * ) ( buf + pos + FW_MAGIC_LEN - 1 ) );
+        hits = _mm_setzero_si128 (  );
+
+        for ( i = 0; i < FW_MAGICS; i++ )
+        {
+            hits = _mm_or_si128 ( hits, _mm_and_si128 ( _mm_cmpeq_epi8 ( head, first[i] ),
+                    _mm_cmpeq_epi8 ( tail, last[i] ) ) );
+        }
+
+        for ( mask = _mm_movemask_epi8 ( hits ); mask; mask &= mask - 1 )
+        {
+            fw_scan_check ( buf, pos + __builtin_ctz ( mask ), fn, arg );
+        }
+    }
+
+    fw_scan_range ( buf, pos, len, fn, arg );
+}
+
+/* Thirty-two positions at once with AVX2 */
+__attribute__ ( ( target ( "avx2" ) ) )
+static void fw_scan_avx2 ( const unsigned char *buf, size_t len, fw_hit_t fn, void *arg )
+{
+    unsigned int i;
+    unsigned int mask;
+    size_t pos;
+    __m256i first[FW_MAGICS];
+    __m256i last[FW_MAGICS];
+    __m256i head, tail, hits;
+
+    for ( i = 0; i < FW_MAGICS; i++ )
+    {
+        first[i] = _mm256_set1_epi8 ( fw_magics[i].bytes[0] );
+        last[i] = _mm256_set1_epi8 ( fw_magics[i].bytes[FW_MAGIC_LEN - 1] );
+    }
+
+    for ( pos = 0; pos + 32 + FW_MAGIC_LEN - 1 <= len; pos += 32 )
+    {
+        head = _mm256_loadu_si256 ( ( const __m256i * ) ( buf + pos ) );
+        tail = _mm256_loadu_si256 ( ( const __m256i * ) ( buf + pos + FW_MAGIC_LEN - 1 ) );
+        hits = _mm256_setzero_si256 (  );
+
+        for ( i = 0; i < FW_MAGICS; i++ )
+        {
+            hits = _mm256_or_si256 ( hits,
+                _mm256_and_si256 ( _mm256_cmpeq_epi8 ( head, first[i] ),
+                    _mm256_cmpeq_epi8 ( tail, last[i] ) ) );
+        }
+
+        for ( mask = _mm256_movemask_epi8 ( hits ); mask; mask &= mask - 1 )
+        {
+            fw_scan_check ( buf, pos + __builtin_ctz ( mask ), fn, arg );
+        }
+    }
+
+    fw_scan_range ( buf, pos, len, fn, arg );
+}
+
+#endif
+
+static fw_scan_kernel_t fw_scan_kernel;
+static const char *fw_scan_engine_name;
+static pthread_once_t fw_scan_once = PTHREAD_ONCE_INIT;
+
+/* Pick the widest scan kernel supported by this cpu */
+static void fw_scan_setup ( void )
+{
+    unsigned int i;
+
+    for ( i = 0; i < FW_MAGICS; i++ )
+    {
+        fw_scan_first[fw_magics[i].bytes[0]] = TRUE;
+    }
+
+    fw_scan_kernel = fw_scan_scalar;
+    fw_scan_engine_name = "scalar";
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init (  );
+
+    if ( __builtin_cpu_supports ( "avx2" ) )
+    {
+        fw_scan_kernel = fw_scan_avx2;
+        fw_scan_engine_name = "avx2";
+    } else
+    {
+        fw_scan_kernel = fw_scan_sse2;
+        fw_scan_engine_name = "sse2";
+    }
+#endif
+}
+
+/* Set scan kernel and first byte table up once, other threads wait until it is done */
+static void fw_scan_init ( void )
+{
+    pthread_once ( &fw_scan_once, fw_scan_setup );
+}
+
+/* Get name of the selected scan engine */
+const char *fw_scan_engine ( void )
+{
+    fw_scan_init (  );
+    return fw_scan_engine_name;
+}
+
+/* Report every position in buffer where a known magic starts */
+void fw_scan_magic ( const unsigned char *buf, size_t len, fw_hit_t fn, void *arg )
+{
+    fw_scan_init (  );
+
+    fw_scan_kernel ( buf, len, fn, arg );
+}
+
+/* Validate header behind a magic, verify and report the image */
+static void fw_scan_hit ( void *arg, size_t pos )
+{
+    unsigned int i;
+    int result;
+    size_t start;
+    size_t extent;
+    const struct fw_format *format;
+    struct fw_scan_state *state = ( struct fw_scan_state * ) arg;
+    struct fw_image *image = state->image;
+    struct fw_image view;
+    struct fw_record record;
+
+    pos += state->base;
+
+    for ( i = 0; i < FW_MAGICS; i++ )
+    {
+        format = fw_magics[i].format;
+
+        if ( ( state->format != &fw_format_auto && state->format != format )
+            || pos < fw_magics[i].off
+            || memcmp ( image->header + pos, fw_magics[i].bytes, FW_MAGIC_LEN ) )
+        {
+            continue;
+        }
+
+        start = pos - fw_magics[i].off;
+
+        if ( !format->probe ( image->header + start, image->header_len - start )
+            || !( extent = format->extent ( image->header + start,
+                    image->header_len - start ) ) )
+        {
+            continue;
+        }
+
+        fw_record_init ( &record, format, state->options, state->path );
+        record.offset = image->offset + start;
+        record.size = extent;
+
+        /* embedded image is verified in place, up to the length its header claims */
+        fw_image_view ( image, start, extent, &view );
+        result = format->verify ? format->verify ( &view, state->options, &record ) : -1;
+
+        if ( state->options->output == FW_OUTPUT_TEXT )
+        {
+            printf ( "%lu : %s : %lu bytes : %s\n", record.offset, format->name,
+                ( unsigned long ) extent, result < 0 ? "found" : fw_result_names[result] );
+
+        } else if ( result >= 0 )
+        {
+            /* records only carry images with a checksum */
+            record.result = result;
+            if ( fw_output_record ( state->output, &record ) < 0 )
+            {
+                state->error = TRUE;
+            }
+        }
+
+        if ( result == FW_RESULT_ERROR )
+        {
+            state->error = TRUE;
+        }
+
+        state->found++;
+    }
+}
+
+/* Scan consumer for fw_image_walk */
+static void fw_scan_walk ( void *arg, const unsigned char *buf, size_t len )
+{
+    size_t more;
+    struct fw_scan_state *state = ( struct fw_scan_state * ) arg;
+
+    /* magics may run over into the next window */
+    state->base = buf - state->image->header;
+    more = state->image->header_len - state->base - len;
+    if ( more > FW_MAGIC_LEN - 1 )
+    {
+        more = FW_MAGIC_LEN - 1;
+    }
+
+    fw_scan_magic ( buf, len + more, fw_scan_hit, state );
+}
+
+/* Search files for embedded headers, verify and report each one found */
+int fw_scan ( const struct fw_format *format, const struct fw_options *options )
+{
+    int status = 0;
+    unsigned int i;
+    struct fw_image image;
+    struct fw_scan_state state;
+    struct fw_output output;
+
+    if ( options->output != FW_OUTPUT_TEXT && fw_output_init ( &output, options->output ) < 0 )
+    {
+        return 1;
+    }
+
+    for ( i = 0; i < options->count; i++ )
+    {
+        if ( fw_image_open ( &image, options->paths[i], TRUE, options->mode, options->advice,
+                options->offset ) < 0 )
+        {
+            status = 1;
+            continue;
+        }
+
+        /* hits are verified in place */
+        if ( image.mode != FW_IMAGE_MAPPED )
+        {
+            fprintf ( stderr, "Error: scan mode needs a mapped file\n" );
+            fw_image_close ( &image );
+            status = 1;
+            continue;
+        }
+
+        memset ( &state, '\0', sizeof ( state ) );
+        state.format = format;
+        state.options = options;
+        state.image = &image;
+        state.path = options->paths[i];
+        state.output = &output;
+
+        if ( fw_image_walk ( &image, 0, FW_TO_END, fw_scan_walk, &state ) < 0 || state.error )
+        {
+            status = 1;
+
+        } else if ( !state.found )
+        {
+            fprintf ( stderr, "Error: no firmware header found\n" );
+            status = 1;
+        }
+
+        fw_image_close ( &image );
+    }
+
+    if ( options->output != FW_OUTPUT_TEXT && fw_output_free ( &output ) < 0 )
+    {
+        status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,246 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Timing Statistics
+ * ------------------------------------------------------------------ */
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "fwutils.h"
+
+/* Linux value, glibc only exposes it with _GNU_SOURCE */
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+
+/* Totals of one phase, summed over all threads */
+struct fw_phase
+{
+    unsigned long calls;
+    uint64_t bytes;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    long majflt;
+    long minflt;
+};
+
+/* Phase names, indexed by FW_PHASE_* */
+static const char *fw_phase_names[] = {
+    "open",
+    "hash",
+    "sync",
+    "close"
+};
+
+static int fw_stats_active;
+static pthread_mutex_t fw_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fw_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t fw_stats_key;
+static struct fw_phase fw_phases[FW_PHASES];
+static uint64_t fw_stats_origin;
+static struct rusage fw_stats_usage;
+
+/* Get clock reading in nanoseconds */
+static uint64_t fw_stats_clock ( clockid_t clock )
+{
+    struct timespec ts;
+
+    clock_gettime ( clock, &ts );
+    return ( uint64_t ) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Get cpu time of rusage in nanoseconds */
+static uint64_t fw_stats_cpu ( const struct rusage *usage )
+{
+    return ( ( uint64_t ) usage->ru_utime.tv_sec + usage->ru_stime.tv_sec ) * 1000000000
+        + ( ( uint64_t ) usage->ru_utime.tv_usec + usage->ru_stime.tv_usec ) * 1000;
+}
+
+/* Create key of the phase open in each thread */
+static void fw_stats_setup ( void )
+{
+    pthread_key_create ( &fw_stats_key, NULL );
+}
+
+/* Start collecting statistics */
+void fw_stats_start ( void )
+{
+    pthread_once ( &fw_stats_once, fw_stats_setup );
+    memset ( fw_phases, '\0', sizeof ( fw_phases ) );
+    getrusage ( RUSAGE_SELF, &fw_stats_usage );
+    fw_stats_origin = fw_stats_clock ( CLOCK_MONOTONIC );
+    fw_stats_active = TRUE;
+}
+
+/* Mark start of a phase in the calling thread, no-op unless collecting */
+void fw_stats_begin ( struct fw_stats_mark *mark )
+{
+    struct rusage usage;
+
+    if ( !( mark->active = fw_stats_active ) )
+    {
+        return;
+    }
+
+    getrusage ( RUSAGE_THREAD, &usage );
+    mark->majflt = usage.ru_majflt;
+    mark->minflt = usage.ru_minflt;
+    mark->cpu_ns = fw_stats_clock ( CLOCK_THREAD_CPUTIME_ID );
+    mark->threads_cpu_ns = 0;
+    mark->threads_majflt = 0;
+    mark->threads_minflt = 0;
+    mark->outer = ( struct fw_stats_mark * ) pthread_getspecific ( fw_stats_key );
+    pthread_setspecific ( fw_stats_key, mark );
+    mark->wall_ns = fw_stats_clock ( CLOCK_MONOTONIC );
+}
+
+/* Account phase begun at mark to its totals */
+void fw_stats_end ( const struct fw_stats_mark *mark, int phase, uint64_t bytes )
+{
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    struct rusage usage;
+    struct fw_phase *totals = &fw_phases[phase];
+
+    if ( !mark->active )
+    {
+        return;
+    }
+
+    wall_ns = fw_stats_clock ( CLOCK_MONOTONIC );
+    cpu_ns = fw_stats_clock ( CLOCK_THREAD_CPUTIME_ID );
+    getrusage ( RUSAGE_THREAD, &usage );
+    pthread_setspecific ( fw_stats_key, mark->outer );
+
+    /* workers of the phase were joined, their share is in the mark */
+    pthread_mutex_lock ( &fw_stats_lock );
+    totals->calls++;
+    totals->bytes += bytes;
+    totals->wall_ns += wall_ns - mark->wall_ns;
+    totals->cpu_ns += cpu_ns - mark->cpu_ns + mark->threads_cpu_ns;
+    totals->majflt += usage.ru_majflt - mark->majflt + mark->threads_majflt;
+    totals->minflt += usage.ru_minflt - mark->minflt + mark->threads_minflt;
+    pthread_mutex_unlock ( &fw_stats_lock );
+}
+
+/* Get phase open in the calling thread, to be handed to its worker threads */
+struct fw_stats_mark *fw_stats_current ( void )
+{
+    if ( !fw_stats_active )
+    {
+        return NULL;
+    }
+
+    return ( struct fw_stats_mark * ) pthread_getspecific ( fw_stats_key );
+}
+
+/* Add cpu time and faults of the calling worker thread so far to phase at mark */
+void fw_stats_thread ( struct fw_stats_mark *mark )
+{
+    uint64_t cpu_ns;
+    struct rusage usage;
+
+    if ( !mark || !mark->active )
+    {
+        return;
+    }
+
+    /* workers are started by the phase, all they did belongs to it */
+    cpu_ns = fw_stats_clock ( CLOCK_THREAD_CPUTIME_ID );
+    getrusage ( RUSAGE_THREAD, &usage );
+
+    pthread_mutex_lock ( &fw_stats_lock );
+    mark->threads_cpu_ns += cpu_ns;
+    mark->threads_majflt += usage.ru_majflt;
+    mark->threads_minflt += usage.ru_minflt;
+    pthread_mutex_unlock ( &fw_stats_lock );
+}
+
+/* Get throughput in GB/s, 0 if nothing was timed */
+static double fw_stats_gbps ( uint64_t bytes, uint64_t ns )
+{
+    return ns ? ( double ) bytes / ns : 0.0;
+}
+
+/* Print statistics to stderr in output format, stop collecting */
+void fw_stats_report ( int output, int scan )
+{
+    int i;
+    char sep = output == FW_OUTPUT_TSV ? '\t' : ',';
+    char engines[256];
+    uint64_t bytes;
+    struct fw_phase total;
+    struct rusage usage;
+    const struct fw_phase *p;
+
+    memset ( &total, '\0', sizeof ( total ) );
+    fflush ( stdout );
+    total.wall_ns = fw_stats_clock ( CLOCK_MONOTONIC ) - fw_stats_origin;
+    getrusage ( RUSAGE_SELF, &usage );
+    total.cpu_ns = fw_stats_cpu ( &usage ) - fw_stats_cpu ( &fw_stats_usage );
+    total.majflt = usage.ru_majflt - fw_stats_usage.ru_majflt;
+    total.minflt = usage.ru_minflt - fw_stats_usage.ru_minflt;
+    bytes = fw_phases[FW_PHASE_HASH].bytes;
+    fw_stats_active = FALSE;
+
+    snprintf ( engines, sizeof ( engines ), "crc32=%s md5=%s md5mb=%s%s%s",
+        crc32_engine (  ), MD5_Engine (  ), MD5_Multi_Engine (  ),
+        scan ? " scan=" : "", scan ? fw_scan_engine (  ) : "" );
+
+    if ( output == FW_OUTPUT_JSON )
+    {
+        fprintf ( stderr, "{\"stats\":{\"phases\":[" );
+        for ( i = 0; i < FW_PHASES; i++ )
+        {
+            p = &fw_phases[i];
+            fprintf ( stderr, "%s{\"phase\":\"%s\",\"calls\":%lu,\"bytes\":%llu,"
+                "\"wall_s\":%.6f,\"cpu_s\":%.6f,\"gbps\":%.3f,"
+                "\"major_faults\":%ld,\"minor_faults\":%ld}", i ? "," : "",
+                fw_phase_names[i], p->calls, ( unsigned long long ) p->bytes,
+                p->wall_ns / 1e9, p->cpu_ns / 1e9, fw_stats_gbps ( p->bytes, p->wall_ns ),
+                p->majflt, p->minflt );
+        }
+        fprintf ( stderr, "],\"wall_s\":%.6f,\"cpu_s\":%.6f,\"gbps\":%.3f,"
+            "\"major_faults\":%ld,\"minor_faults\":%ld,\"engines\":{\"crc32\":\"%s\","
+            "\"md5\":\"%s\",\"md5mb\":\"%s\"", total.wall_ns / 1e9, total.cpu_ns / 1e9,
+            fw_stats_gbps ( bytes, total.wall_ns ), total.majflt, total.minflt,
+            crc32_engine (  ), MD5_Engine (  ), MD5_Multi_Engine (  ) );
+        if ( scan )
+        {
+            fprintf ( stderr, ",\"scan\":\"%s\"", fw_scan_engine (  ) );
+        }
+        fprintf ( stderr, "}}}\n" );
+
+    } else if ( output == FW_OUTPUT_CSV || output == FW_OUTPUT_TSV )
+    {
+        fprintf ( stderr, "phase%ccalls%cbytes%cwall_s%ccpu_s%cgbps%cmajor_faults%c"
+            "minor_faults%cengines\n", sep, sep, sep, sep, sep, sep, sep, sep );
+        for ( i = 0; i < FW_PHASES; i++ )
+        {
+            p = &fw_phases[i];
+            fprintf ( stderr, "%s%c%lu%c%llu%c%.6f%c%.6f%c%.3f%c%ld%c%ld%c\n",
+                fw_phase_names[i], sep, p->calls, sep, ( unsigned long long ) p->bytes, sep,
+                p->wall_ns / 1e9, sep, p->cpu_ns / 1e9, sep,
+                fw_stats_gbps ( p->bytes, p->wall_ns ), sep, p->majflt, sep, p->minflt, sep );
+        }
+        fprintf ( stderr, "total%c%c%llu%c%.6f%c%.6f%c%.3f%c%ld%c%ld%c%s\n", sep, sep,
+            ( unsigned long long ) bytes, sep, total.wall_ns / 1e9, sep, total.cpu_ns / 1e9,
+            sep, fw_stats_gbps ( bytes, total.wall_ns ), sep, total.majflt, sep, total.minflt,
+            sep, engines );
+
+    } else
+    {
+        for ( i = 0; i < FW_PHASES; i++ )
+        {
+            p = &fw_phases[i];
+            fprintf ( stderr, "stats %-6s: %lu calls, %llu bytes, wall %.6f s, cpu %.6f s, "
+                "%.3f GB/s, faults %ld major %ld minor\n", fw_phase_names[i], p->calls,
+                ( unsigned long long ) p->bytes, p->wall_ns / 1e9, p->cpu_ns / 1e9,
+                fw_stats_gbps ( p->bytes, p->wall_ns ), p->majflt, p->minflt );
+        }
+        fprintf ( stderr, "stats total : %llu bytes, wall %.6f s, cpu %.6f s, %.3f GB/s, "
+            "faults %ld major %ld minor\n", ( unsigned long long ) bytes, total.wall_ns / 1e9,
+            total.cpu_ns / 1e9, fw_stats_gbps ( bytes, total.wall_ns ), total.majflt,
+            total.minflt );
+        fprintf ( stderr, "stats engine: %s\n", engines );
+    }
+}
@@ -0,0 +1,104 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils - Synthetic Image Builder
+ * ------------------------------------------------------------------ */
+
+#include <arpa/inet.h>
+
+#include "fwsynth.h"
+#include "trxcrc32.h"
+#include "bcmcrc32.h"
+#include "tlmd5.h"
+
+/* Fill buffer with xorshift noise, same for same seed */
+void fw_fill ( unsigned char *buf, size_t len, uint64_t seed )
+{
+    size_t i;
+    uint64_t x = seed | 1;
+
+    for ( i = 0; i < len; i++ )
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = x >> 32;
+    }
+}
+
+/* Store number as ascii into header field, not terminated if it fills the field */
+static int fw_ascii ( uint8_t * field, size_t size, unsigned long value )
+{
+    char str[32];
+    size_t len = snprintf ( str, sizeof ( str ), "%lu", value );
+
+    if ( len > size )
+    {
+        return -1;
+    }
+
+    memcpy ( field, str, len );
+    return 0;
+}
+
+/* Store header skeleton of format in front of payload, checksums left zero */
+int fw_skeleton ( const char *format, unsigned char *buf, size_t size )
+{
+    struct trx_header *trx = ( struct trx_header * ) buf;
+    struct bcm_header_v1 *bcm = ( struct bcm_header_v1 * ) buf;
+    struct fw_header_v1 *tplink = ( struct fw_header_v1 * ) buf;
+
+    if ( !strcmp ( format, "trx" ) )
+    {
+        if ( size < sizeof ( struct trx_header ) )
+        {
+            return -1;
+        }
+
+        memset ( trx, '\0', sizeof ( struct trx_header ) );
+        trx->magic = TRX_MAGIC;
+        trx->len = size;
+        trx->version = 1;
+        trx->offsets[0] = sizeof ( struct trx_header );
+
+    } else if ( !strcmp ( format, "bcm" ) )
+    {
+        if ( size <= 256 )
+        {
+            return -1;
+        }
+
+        /* payload split between rootfs and kernel */
+        memset ( bcm, '\0', 256 );
+        bcm->magic[0] = 0x36;
+        memcpy ( bcm->vendor, "Broadcom Corporation", sizeof ( bcm->vendor ) );
+        bcm->endian_flag[0] = '1';
+        if ( fw_ascii ( bcm->total_size, sizeof ( bcm->total_size ), size - 256 ) < 0
+            || fw_ascii ( bcm->loader_size, sizeof ( bcm->loader_size ), 0 ) < 0
+            || fw_ascii ( bcm->rootfs_size, sizeof ( bcm->rootfs_size ),
+                ( size - 256 ) / 2 ) < 0
+            || fw_ascii ( bcm->kernel_size, sizeof ( bcm->kernel_size ),
+                ( size - 256 ) - ( size - 256 ) / 2 ) < 0 )
+        {
+            return -1;
+        }
+
+    } else if ( !strcmp ( format, "tplink" ) )
+    {
+        if ( size <= sizeof ( struct fw_header_v1 ) )
+        {
+            return -1;
+        }
+
+        memset ( tplink, '\0', sizeof ( struct fw_header_v1 ) );
+        tplink->version = htonl ( HEADER_VERSION_V1 );
+        memcpy ( tplink->vendor_name, "TP-LINK Technologies", 20 );
+        tplink->fw_length = htonl ( size );
+        tplink->kernel_ofs = htonl ( sizeof ( struct fw_header_v1 ) );
+        tplink->kernel_len = htonl ( size - sizeof ( struct fw_header_v1 ) );
+
+    } else
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,625 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - TP-Link Format
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+#include "tlmd5.h"
+
+#define BATCH_GROUP 16
+#define MIDSTATE_CACHE 16
+
+static const unsigned char md5salt_normal_v1[MD5SUM_LEN] = {
+    0xdc, 0xd7, 0x3a, 0xa5, 0xc3, 0x95, 0x98, 0xfb,
+    0xdd, 0xf9, 0xe7, 0xf4, 0x0e, 0xae, 0x47, 0x38,
+};
+
+static const unsigned char md5salt_normal_v2[MD5SUM_LEN] = {
+    0xdc, 0xd7, 0x3a, 0xa5, 0xc3, 0x95, 0x98, 0xfb,
+    0xdc, 0xf9, 0xe7, 0xf4, 0x0e, 0xae, 0x47, 0x37,
+};
+
+static const unsigned char md5salt_boot[MD5SUM_LEN] = {
+    0x8c, 0xef, 0x33, 0x5b, 0xd5, 0xc5, 0xce, 0xfa,
+    0xa7, 0x9c, 0x28, 0xda, 0xb2, 0xe9, 0x0f, 0x42,
+};
+
+/* Copy firmware header string into buffer */
+static void hdr_copy_string ( char *dest, size_t dest_size, const char *src, size_t src_size )
+{
+    size_t src_len;
+
+    for ( src_len = 0; src_len < src_size; src_len++ )
+    {
+        if ( src[src_len] == '\0' )
+        {
+            break;
+        }
+    }
+
+    if ( dest_size <= src_len )
+    {
+        return;
+    }
+
+    memcpy ( dest, src, src_len );
+    dest[src_len] = '\0';
+}
+
+/* Print hex data */
+static void hex_dump ( const char *prefix, const unsigned char *src, size_t len )
+{
+    size_t i;
+
+    printf ( "%s", prefix );
+
+    for ( i = 0; i < len; i++ )
+    {
+        printf ( "%.2x", src[i] );
+
+        if ( i + 1 < len )
+        {
+            putchar ( '\x20' );
+        }
+    }
+
+    putchar ( '\n' );
+}
+
+/* Midstate after a salted header, headers repeat when images differ in payload only */
+struct midstate
+{
+    int valid;
+    unsigned char header[sizeof ( struct fw_header_v1 )];
+    MD5_STATE state;
+};
+
+static struct midstate midstate_cache[MIDSTATE_CACHE];
+static unsigned int midstate_next;
+static pthread_mutex_t midstate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Start md5 over a salted header, resuming a cached midstate if possible */
+static void md5_start_cached ( const void *test, size_t len, MD5_CTX * ctx )
+{
+    unsigned int i;
+    struct midstate *entry;
+
+    MD5_Init ( ctx );
+
+    pthread_mutex_lock ( &midstate_lock );
+    for ( i = 0; i < MIDSTATE_CACHE; i++ )
+    {
+        entry = &midstate_cache[i];
+        if ( entry->valid && len == sizeof ( entry->header )
+            && !memcmp ( entry->header, test, len ) )
+        {
+            MD5_Restore ( ctx, &entry->state );
+            pthread_mutex_unlock ( &midstate_lock );
+            return;
+        }
+    }
+    pthread_mutex_unlock ( &midstate_lock );
+
+    MD5_Update ( ctx, test, len );
+
+    /* replace cache entries round robin */
+    if ( len == sizeof ( entry->header ) )
+    {
+        pthread_mutex_lock ( &midstate_lock );
+        entry = &midstate_cache[midstate_next];
+        if ( !MD5_Save ( ctx, &entry->state ) )
+        {
+            memcpy ( entry->header, test, len );
+            entry->valid = TRUE;
+            midstate_next = ( midstate_next + 1 ) % MIDSTATE_CACHE;
+        }
+        pthread_mutex_unlock ( &midstate_lock );
+    }
+}
+
+/* Start md5 over header V1 with the salt in place of md5sum1 */
+static void md5_start_v1 ( const struct fw_header_v1 *header, MD5_CTX * ctx )
+{
+    struct fw_header_v1 test;
+
+    memcpy ( &test, header, sizeof ( struct fw_header_v1 ) );
+    if ( !header->boot_len )
+    {
+        memcpy ( test.md5sum1, md5salt_normal_v1, sizeof ( test.md5sum1 ) );
+    } else
+    {
+        memcpy ( test.md5sum1, md5salt_boot, sizeof ( test.md5sum1 ) );
+    }
+    md5_start_cached ( &test, sizeof ( test ), ctx );
+}
+
+/* Start md5 over header V2 with the salt in place of md5sum1 */
+static void md5_start_v2 ( const struct fw_header_v2 *header, MD5_CTX * ctx )
+{
+    struct fw_header_v2 test;
+
+    memcpy ( &test, header, sizeof ( struct fw_header_v2 ) );
+    if ( !header->boot_len )
+    {
+        memcpy ( test.md5sum1, md5salt_normal_v2, sizeof ( test.md5sum1 ) );
+    } else
+    {
+        memcpy ( test.md5sum1, md5salt_boot, sizeof ( test.md5sum1 ) );
+    }
+    md5_start_cached ( &test, sizeof ( test ), ctx );
+}
+
+/* Process TP-Link firmware header V1 */
+static int process_header_v1 ( struct fw_image *image, int readonly, int *needsync )
+{
+    int md5sum1_status;
+    size_t length;
+    struct fw_header_v1 *header = ( struct fw_header_v1 * ) image->header;
+    MD5_CTX ctx;
+    char buffer[256];
+    unsigned char md5_calc[MD5SUM_LEN];
+
+    /* recaluclate and check md5 1 checksum */
+    md5_start_v1 ( header, &ctx );
+    if ( fw_image_md5 ( image, sizeof ( struct fw_header_v1 ), FW_TO_END, &ctx ) < 0 )
+    {
+        return -1;
+    }
+    MD5_Final ( md5_calc, &ctx );
+    md5sum1_status = !memcmp ( header->md5sum1, md5_calc, MD5SUM_LEN );
+
+    /* streamed input has been consumed, its size is known now */
+    length = fw_image_size ( image );
+
+    /* dump trx header */
+    hdr_copy_string ( buffer, sizeof ( buffer ), header->vendor_name,
+        sizeof ( header->vendor_name ) );
+    printf ( "vendor name   : %s\n", buffer );
+    hdr_copy_string ( buffer, sizeof ( buffer ), header->fw_version,
+        sizeof ( header->fw_version ) );
+    printf ( "version       : %s\n", buffer );
+    printf ( "hardware id   : 0x%.8x\n", ntohl ( header->hw_id ) );
+    printf ( "hardware rev  : %u\n", ntohl ( header->hw_rev ) );
+    printf ( "region        : %u\n", ntohl ( header->region ) );
+    printf ( "reserved 2    : %u\n", ntohl ( header->unk2 ) );
+    printf ( "reserved 3    : %u\n", ntohl ( header->unk3 ) );
+    printf ( "load address  : 0x%.8x\n", ntohl ( header->kernel_la ) );
+    printf ( "entry point   : 0x%.8x\n", ntohl ( header->kernel_ep ) );
+    printf ( "total length  : %u (%s)\n", ntohl ( header->fw_length ),
+        ntohl ( header->fw_length ) == length ? "ok" : "bad" );
+    printf ( "kernel offset : %u\n", ntohl ( header->kernel_ofs ) );
+    printf ( "kernel length : %u\n", ntohl ( header->kernel_len ) );
+    printf ( "rootfs offset : %u\n", ntohl ( header->rootfs_ofs ) );
+    printf ( "rootfs length : %u\n", ntohl ( header->rootfs_len ) );
+    printf ( "boot offset   : %u\n", ntohl ( header->boot_ofs ) );
+    printf ( "boot length   : %u\n", ntohl ( header->boot_len ) );
+    printf ( "firmware ver. : %u.%u.%u\n", ntohs ( header->ver_hi ), ntohs ( header->ver_mid ),
+        ntohs ( header->ver_lo ) );
+
+    /* dump md5 checksums */
+    hex_dump ( "md5 1 sum     : ", header->md5sum1, sizeof ( header->md5sum1 ) );
+    hex_dump ( "md5 2 sum     : ", header->md5sum2, sizeof ( header->md5sum2 ) );
+
+    if ( md5sum1_status )
+    {
+        printf ( "md5 1 status  : correct\n" );
+
+    } else
+    {
+        printf ( "md5 1 status  : incorrect\n" );
+    }
+
+    printf ( "\n" );
+
+    /* update crc32 checksum if needed */
+    if ( !readonly && !md5sum1_status )
+    {
+        memcpy ( header->md5sum1, md5_calc, MD5SUM_LEN );
+        fw_image_dirty ( image, offsetof ( struct fw_header_v1, md5sum1 ), MD5SUM_LEN );
+        *needsync = TRUE;
+    } else
+    {
+        *needsync = FALSE;
+    }
+
+    return 0;
+}
+
+/* Process TP-Link firmware header V2 */
+static int process_header_v2 ( struct fw_image *image, int readonly, int *needsync )
+{
+    int md5sum1_status;
+    size_t length;
+    struct fw_header_v2 *header = ( struct fw_header_v2 * ) image->header;
+    MD5_CTX ctx;
+    char buffer[256];
+    unsigned char md5_calc[MD5SUM_LEN];
+
+    /* recaluclate and check md5 1 checksum */
+    md5_start_v2 ( header, &ctx );
+    if ( fw_image_md5 ( image, sizeof ( struct fw_header_v2 ), FW_TO_END, &ctx ) < 0 )
+    {
+        return -1;
+    }
+    MD5_Final ( md5_calc, &ctx );
+    md5sum1_status = !memcmp ( header->md5sum1, md5_calc, MD5SUM_LEN );
+
+    /* streamed input has been consumed, its size is known now */
+    length = fw_image_size ( image );
+
+    /* dump trx header */
+    hdr_copy_string ( buffer, sizeof ( buffer ), header->fw_version,
+        sizeof ( header->fw_version ) );
+    printf ( "version       : %s\n", buffer );
+    printf ( "hardware id   : 0x%.8x\n", ntohl ( header->hw_id ) );
+    printf ( "hardware rev  : %u\n", ntohl ( header->hw_rev ) );
+    printf ( "reserved 1    : %u\n", ntohl ( header->unk1 ) );
+    printf ( "reserved 2    : %u\n", ntohl ( header->unk2 ) );
+    printf ( "reserved 3    : %u\n", ntohl ( header->unk3 ) );
+    printf ( "load address  : 0x%.8x\n", ntohl ( header->kernel_la ) );
+    printf ( "entry point   : 0x%.8x\n", ntohl ( header->kernel_ep ) );
+    printf ( "total length  : %u (%s)\n", ntohl ( header->fw_length ),
+        ntohl ( header->fw_length ) == length ? "ok" : "bad" );
+    printf ( "kernel offset : %u\n", ntohl ( header->kernel_ofs ) );
+    printf ( "kernel length : %u\n", ntohl ( header->kernel_len ) );
+    printf ( "rootfs offset : %u\n", ntohl ( header->rootfs_ofs ) );
+    printf ( "rootfs length : %u\n", ntohl ( header->rootfs_len ) );
+    printf ( "boot offset   : %u\n", ntohl ( header->boot_ofs ) );
+    printf ( "boot length   : %u\n", ntohl ( header->boot_len ) );
+    printf ( "reserved 4    : %u\n", ntohs ( header->unk4 ) );
+    printf ( "s version     : %u.%u\n", ntohs ( header->sver_hi ), ntohs ( header->sver_lo ) );
+    printf ( "reserved 5    : %u\n", header->unk5 );
+    printf ( "firmware ver. : %u.%u.%u\n", ntohs ( header->ver_hi ), ntohs ( header->ver_mid ),
+        ntohs ( header->ver_lo ) );
+
+    /* dump md5 checksums */
+    hex_dump ( "md5 1 sum     : ", header->md5sum1, sizeof ( header->md5sum1 ) );
+    hex_dump ( "md5 2 sum     : ", header->md5sum2, sizeof ( header->md5sum2 ) );
+
+    if ( md5sum1_status )
+    {
+        printf ( "md5 1 status  : correct\n" );
+
+    } else
+    {
+        printf ( "md5 1 status  : incorrect\n" );
+    }
+
+    printf ( "\n" );
+
+    /* update crc32 checksum if needed */
+    if ( !readonly && !md5sum1_status )
+    {
+        memcpy ( header->md5sum1, md5_calc, MD5SUM_LEN );
+        fw_image_dirty ( image, offsetof ( struct fw_header_v2, md5sum1 ), MD5SUM_LEN );
+        *needsync = TRUE;
+    } else
+    {
+        *needsync = FALSE;
+    }
+
+    return 0;
+}
+
+/* Detect TP-Link firmware header version */
+static int header_version ( const unsigned char *base, size_t length )
+{
+    uint32_t header_ver;
+
+    /* at least 4 bytes long */
+    if ( length < sizeof ( uint32_t ) )
+    {
+        return -1;
+    }
+
+    memcpy ( &header_ver, base, sizeof ( header_ver ) );
+
+    /* load header version from file */
+    if ( header_ver == HEADER_VERSION_V1 || ntohl ( header_ver ) == HEADER_VERSION_V1 )
+    {
+        return HEADER_VERSION_V1;
+
+    } else if ( header_ver == HEADER_VERSION_V2 || ntohl ( header_ver ) == HEADER_VERSION_V2 )
+    {
+        return HEADER_VERSION_V2;
+    }
+
+    /* unknown firmware header */
+    return -1;
+}
+
+/* Verify TP-Link image, update checksum if needed */
+static int tplink_process ( struct fw_image *image, const struct fw_options *options )
+{
+    int version;
+    int status;
+    int needsync = FALSE;
+
+    if ( ( version = header_version ( image->header, image->header_len ) ) < 0 )
+    {
+        fprintf ( stderr, "Error: TP-Link header not found\n" );
+        return -1;
+    }
+
+    /* print header version if possible */
+    printf ( "fw header ver : V%d\n", version );
+
+    /* branch according to header version */
+    if ( version == HEADER_VERSION_V1 )
+    {
+        /* firmware header V1 */
+        if ( image->header_len <= sizeof ( struct fw_header_v1 ) )
+        {
+            fprintf ( stderr, "Error: TP-Link header not found\n" );
+            return -1;
+        }
+
+        status = process_header_v1 ( image, options->readonly, &needsync );
+
+    } else
+    {
+        /* firmware header V2 */
+        if ( image->header_len <= sizeof ( struct fw_header_v2 ) )
+        {
+            fprintf ( stderr, "Error: TP-Link header not found\n" );
+            return -1;
+        }
+
+        status = process_header_v2 ( image, options->readonly, &needsync );
+    }
+
+    if ( status < 0 )
+    {
+        return -1;
+    }
+
+    if ( needsync )
+    {
+        if ( fw_image_sync ( image ) < 0 )
+        {
+            return -1;
+        }
+
+        printf ( "Note: checksum has been updated.\n\n" );
+    }
+
+    return 0;
+}
+
+/* Check for TP-Link header */
+static int tplink_probe ( const unsigned char *header, size_t len )
+{
+    int version;
+
+    if ( ( version = header_version ( header, len ) ) < 0 )
+    {
+        return FALSE;
+    }
+
+    return len > ( version == HEADER_VERSION_V1 ? sizeof ( struct fw_header_v1 )
+        : sizeof ( struct fw_header_v2 ) );
+}
+
+/* Check text field is printable and zero padded, and not empty if required */
+static int tplink_text ( const unsigned char *text, size_t len, int required )
+{
+    size_t i;
+    size_t end;
+
+    for ( end = 0; end < len && text[end]; end++ )
+    {
+        if ( text[end] < 0x20 || text[end] > 0x7e )
+        {
+            return FALSE;
+        }
+    }
+
+    /* headers are cleared before the strings are copied in */
+    for ( i = end; i < len; i++ )
+    {
+        if ( text[i] )
+        {
+            return FALSE;
+        }
+    }
+
+    return end < len && ( end || !required );
+}
+
+/* Get TP-Link image length, 0 if header is inconsistent */
+static size_t tplink_extent ( const unsigned char *header, size_t len )
+{
+    int text;
+    uint32_t field[5];
+    uint64_t fw_length;
+    uint64_t kernel_ofs;
+    uint64_t kernel_len;
+    uint64_t rootfs_ofs;
+    uint64_t rootfs_len;
+    size_t hdrlen;
+
+    /* the version word alone is common in any binary, the strings have to be text */
+    if ( header_version ( header, len ) == HEADER_VERSION_V1 )
+    {
+        hdrlen = sizeof ( struct fw_header_v1 );
+        text = tplink_text ( header + offsetof ( struct fw_header_v1, vendor_name ),
+            sizeof ( ( ( struct fw_header_v1 * ) 0 )->vendor_name ), TRUE )
+            && tplink_text ( header + offsetof ( struct fw_header_v1, fw_version ),
+            sizeof ( ( ( struct fw_header_v1 * ) 0 )->fw_version ), FALSE );
+        memcpy ( field, header + offsetof ( struct fw_header_v1, fw_length ), sizeof ( field ) );
+    } else
+    {
+        hdrlen = sizeof ( struct fw_header_v2 );
+        text = tplink_text ( header + offsetof ( struct fw_header_v2, fw_version ),
+            sizeof ( ( ( struct fw_header_v2 * ) 0 )->fw_version ), TRUE );
+        memcpy ( field, header + offsetof ( struct fw_header_v2, fw_length ), sizeof ( field ) );
+    }
+
+    /* both versions store fw_length, kernel and rootfs ranges in a row */
+    fw_length = ntohl ( field[0] );
+    kernel_ofs = ntohl ( field[1] );
+    kernel_len = ntohl ( field[2] );
+    rootfs_ofs = ntohl ( field[3] );
+    rootfs_len = ntohl ( field[4] );
+
+    /* ranges follow the header and do not overlap */
+    if ( !text || fw_length <= hdrlen || fw_length > len
+        || kernel_ofs < hdrlen || kernel_ofs + kernel_len > fw_length
+        || ( rootfs_len && rootfs_ofs < hdrlen ) || rootfs_ofs + rootfs_len > fw_length
+        || ( kernel_len && rootfs_len && kernel_ofs < rootfs_ofs + rootfs_len
+            && rootfs_ofs < kernel_ofs + kernel_len ) )
+    {
+        return 0;
+    }
+
+    return fw_length;
+}
+
+/* Start md5 over the salted header, get stored md5sum and header length, 0 if not found */
+static size_t tplink_start ( const struct fw_image *image, MD5_CTX * ctx,
+    unsigned char md5sum[MD5SUM_LEN] )
+{
+    int version;
+    size_t hdrlen;
+
+    version = header_version ( image->header, image->header_len );
+    hdrlen = version == HEADER_VERSION_V1 ? sizeof ( struct fw_header_v1 )
+        : sizeof ( struct fw_header_v2 );
+
+    if ( version < 0 || image->header_len <= hdrlen )
+    {
+        fprintf ( stderr, "Error: TP-Link header not found\n" );
+        return 0;
+    }
+
+    if ( version == HEADER_VERSION_V1 )
+    {
+        md5_start_v1 ( ( const struct fw_header_v1 * ) image->header, ctx );
+        memcpy ( md5sum, ( ( const struct fw_header_v1 * ) image->header )->md5sum1,
+            MD5SUM_LEN );
+    } else
+    {
+        md5_start_v2 ( ( const struct fw_header_v2 * ) image->header, ctx );
+        memcpy ( md5sum, ( ( const struct fw_header_v2 * ) image->header )->md5sum1,
+            MD5SUM_LEN );
+    }
+
+    return hdrlen;
+}
+
+/* Verify TP-Link image without reporting details */
+static int tplink_verify ( struct fw_image *image, const struct fw_options *options,
+    struct fw_record *record )
+{
+    size_t hdrlen;
+    MD5_CTX ctx;
+    unsigned char md5sum[MD5SUM_LEN];
+    unsigned char md5_calc[MD5SUM_LEN];
+
+    ( void ) options;
+
+    if ( !( hdrlen = tplink_start ( image, &ctx, md5sum ) ) )
+    {
+        return FW_RESULT_ERROR;
+    }
+
+    if ( fw_image_md5 ( image, hdrlen, FW_TO_END, &ctx ) < 0 )
+    {
+        return FW_RESULT_ERROR;
+    }
+
+    MD5_Final ( md5_calc, &ctx );
+    fw_record_md5 ( record, "md5", md5sum, md5_calc );
+
+    return memcmp ( md5sum, md5_calc, MD5SUM_LEN ) ? FW_RESULT_INCORRECT : FW_RESULT_CORRECT;
+}
+
+/* Verify a group of files, hashing their payloads in lockstep */
+static void tplink_verify_group ( char *paths[], unsigned int count,
+    const struct fw_options *options, struct fw_record records[] )
+{
+    unsigned int i;
+    unsigned int n = 0;
+    size_t hdrlen;
+    int opened[BATCH_GROUP];
+    struct fw_image image[BATCH_GROUP];
+    unsigned char md5sum[BATCH_GROUP][MD5SUM_LEN];
+    MD5_CTX ctx[BATCH_GROUP];
+    MD5_CTX *ctxp[BATCH_GROUP];
+    const void *buf[BATCH_GROUP];
+    size_t len[BATCH_GROUP];
+    size_t total;
+    unsigned char md5_calc[MD5SUM_LEN];
+    struct fw_stats_mark mark;
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( fw_image_open ( &image[i], paths[i], TRUE, options->mode, options->advice,
+                options->offset ) < 0 )
+        {
+            opened[i] = FALSE;
+            continue;
+        }
+
+        opened[i] = TRUE;
+
+        /* salted header first, payloads go into the lanes below */
+        if ( !( hdrlen = tplink_start ( &image[i], &ctx[i], md5sum[i] ) ) )
+        {
+            fw_image_close ( &image[i] );
+            opened[i] = FALSE;
+            continue;
+        }
+
+        /* only mapped payloads can be hashed in lockstep */
+        if ( image[i].mode == FW_IMAGE_MAPPED )
+        {
+            ctxp[n] = &ctx[i];
+            buf[n] = image[i].header + hdrlen;
+            len[n] = fw_image_size ( &image[i] ) - hdrlen;
+            n++;
+
+        } else if ( fw_image_md5 ( &image[i], hdrlen, FW_TO_END, &ctx[i] ) < 0 )
+        {
+            fw_image_close ( &image[i] );
+            opened[i] = FALSE;
+        }
+    }
+
+    if ( n )
+    {
+        fw_stats_begin ( &mark );
+        MD5_Update_Multi ( ctxp, buf, len, n );
+        for ( i = 0, total = 0; i < n; i++ )
+        {
+            total += len[i];
+        }
+        fw_stats_end ( &mark, FW_PHASE_HASH, total );
+    }
+
+    for ( i = 0; i < count; i++ )
+    {
+        if ( opened[i] )
+        {
+            MD5_Final ( md5_calc, &ctx[i] );
+            fw_record_md5 ( &records[i], "md5", md5sum[i], md5_calc );
+            records[i].size = fw_image_size ( &image[i] );
+            records[i].result = memcmp ( md5sum[i], md5_calc, MD5SUM_LEN )
+                ? FW_RESULT_INCORRECT : FW_RESULT_CORRECT;
+            fw_image_close ( &image[i] );
+        } else
+        {
+            records[i].result = FW_RESULT_ERROR;
+        }
+    }
+}
+
+const struct fw_format fw_format_tplink = {
+    "tplink",
+    BATCH_GROUP,
+    tplink_probe,
+    tplink_extent,
+    tplink_process,
+    tplink_verify,
+    tplink_verify_group,
+    NULL
+};
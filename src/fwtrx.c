@@ -0,0 +1,223 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - TRX Format
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+#include "trxcrc32.h"
+
+/* Check for TRX header */
+static int trx_probe ( const unsigned char *header, size_t len )
+{
+    uint32_t magic;
+
+    if ( len < sizeof ( struct trx_header ) )
+    {
+        return FALSE;
+    }
+
+    memcpy ( &magic, header, sizeof ( magic ) );
+    return magic == TRX_MAGIC;
+}
+
+/* Get TRX image length, 0 if header is inconsistent */
+static size_t trx_extent ( const unsigned char *header, size_t len )
+{
+    unsigned int i;
+    struct trx_header trx;
+
+    memcpy ( &trx, header, sizeof ( trx ) );
+
+    if ( trx.len < sizeof ( trx ) || trx.len > len || trx.version < 1 || trx.version > 2 )
+    {
+        return 0;
+    }
+
+    /* partitions lie within the image, unused ones are zero */
+    for ( i = 0; i < 3; i++ )
+    {
+        if ( trx.offsets[i] >= trx.len )
+        {
+            return 0;
+        }
+    }
+
+    return trx.len;
+}
+
+/* Verify TRX image, update checksum if needed */
+static int trx_process ( struct fw_image *image, const struct fw_options *options )
+{
+    uint32_t crc32_calc;
+    size_t flags_off;
+    struct trx_header *header = ( struct trx_header * ) image->header;
+
+    if ( image->header_len < sizeof ( struct trx_header ) || header->magic != TRX_MAGIC )
+    {
+        fprintf ( stderr, "Error: TRX header not found\n" );
+        return -1;
+    }
+
+    /* dump trx header */
+    printf ( "trx magic  : %.2x %.2x %.2x %.2x\n",
+        ( ( unsigned char * ) ( &header->magic ) )[0],
+        ( ( unsigned char * ) ( &header->magic ) )[1],
+        ( ( unsigned char * ) ( &header->magic ) )[2],
+        ( ( unsigned char * ) ( &header->magic ) )[3] );
+
+    printf ( "trx length : %u\n", header->len );
+    printf ( "trx crc32  : 0x%.8x\n", header->crc32 );
+    printf ( "trx flags  : %u\n", header->flags );
+    printf ( "trx ver.   : %u\n", header->version );
+    printf ( "trx off #1 : %u\n", header->offsets[0] );
+    printf ( "trx off #2 : %u\n", header->offsets[1] );
+    printf ( "trx off #3 : %u\n", header->offsets[2] );
+    /* offset 4 not applicable to trx v1 */
+    if ( header->version > 1 )
+    {
+        printf ( "trx off #4 : %u\n", header->offsets[3] );
+    }
+    printf ( "\n" );
+
+    flags_off = ( void * ) &header->flags - ( void * ) header;
+
+    if ( flags_off > header->len )
+    {
+        fprintf ( stderr, "Error: no data left to check with crc32\n" );
+        return -1;
+    }
+
+    if ( fw_image_crc32_mt ( image, flags_off, header->len - flags_off, options->threads,
+            &crc32_calc ) < 0 )
+    {
+        return -1;
+    }
+
+    printf ( "crc32 calc : 0x%.8x\n", crc32_calc );
+
+    if ( header->crc32 == crc32_calc )
+    {
+        printf ( "crc status : correct\n" );
+
+    } else
+    {
+        printf ( "crc status : incorrect\n" );
+    }
+
+    printf ( "\n" );
+
+    /* update crc32 checksum if needed */
+    if ( !options->readonly && header->crc32 != crc32_calc )
+    {
+        header->crc32 = crc32_calc;
+        fw_image_dirty ( image, offsetof ( struct trx_header, crc32 ), sizeof ( header->crc32 ) );
+
+        if ( fw_image_sync ( image ) < 0 )
+        {
+            return -1;
+        }
+
+        printf ( "Note: checksum has been updated.\n\n" );
+    }
+
+    return 0;
+}
+
+/* Verify TRX image without reporting details */
+static int trx_verify ( struct fw_image *image, const struct fw_options *options,
+    struct fw_record *record )
+{
+    uint32_t crc32_calc;
+    size_t flags_off = offsetof ( struct trx_header, flags );
+    struct trx_header *header = ( struct trx_header * ) image->header;
+
+    ( void ) options;
+
+    if ( image->header_len < sizeof ( struct trx_header ) || header->magic != TRX_MAGIC )
+    {
+        fprintf ( stderr, "Error: TRX header not found\n" );
+        return FW_RESULT_ERROR;
+    }
+
+    if ( flags_off > header->len )
+    {
+        fprintf ( stderr, "Error: no data left to check with crc32\n" );
+        return FW_RESULT_ERROR;
+    }
+
+    /* batch workers already keep every cpu busy */
+    if ( fw_image_crc32 ( image, flags_off, header->len - flags_off, &crc32_calc ) < 0 )
+    {
+        return FW_RESULT_ERROR;
+    }
+
+    fw_record_crc32 ( record, "crc32", header->crc32, crc32_calc );
+
+    return header->crc32 == crc32_calc ? FW_RESULT_CORRECT : FW_RESULT_INCORRECT;
+}
+
+/* Patch TRX image in place, crc32 follows the delta */
+static int trx_patch ( struct fw_image *image, const struct fw_options *options )
+{
+    uint32_t crc32_old;
+    size_t flags_off = offsetof ( struct trx_header, flags );
+    unsigned char *old;
+    struct trx_header *header = ( struct trx_header * ) image->header;
+
+    if ( image->header_len < sizeof ( struct trx_header ) || header->magic != TRX_MAGIC )
+    {
+        fprintf ( stderr, "Error: TRX header not found\n" );
+        return -1;
+    }
+
+    /* bytes outside of crc32 coverage would leave it unchanged */
+    if ( options->patch_off < flags_off || options->patch_off > header->len
+        || options->patch_len > header->len - options->patch_off )
+    {
+        fprintf ( stderr, "Error: patch is outside of crc32 range\n" );
+        return -1;
+    }
+
+    if ( !( old = ( unsigned char * ) malloc ( options->patch_len ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( fw_image_patch ( image, options->patch_off, options->patch, options->patch_len,
+            old ) < 0 )
+    {
+        free ( old );
+        return -1;
+    }
+
+    crc32_old = header->crc32;
+    header->crc32 = crc32_patch ( header->crc32, old, options->patch, options->patch_len,
+        header->len - options->patch_off - options->patch_len );
+    free ( old );
+
+    printf ( "patch      : %lu bytes at %lu\n", ( unsigned long ) options->patch_len,
+        options->patch_off );
+    printf ( "crc32 old  : 0x%.8x\n", crc32_old );
+    printf ( "crc32 new  : 0x%.8x\n\n", header->crc32 );
+
+    fw_image_dirty ( image, offsetof ( struct trx_header, crc32 ), sizeof ( header->crc32 ) );
+
+    if ( fw_image_sync ( image ) < 0 )
+    {
+        return -1;
+    }
+
+    printf ( "Note: image has been patched.\n\n" );
+    return 0;
+}
+
+const struct fw_format fw_format_trx = {
+    "trx",
+    1,
+    trx_probe,
+    trx_extent,
+    trx_process,
+    trx_verify,
+    NULL,
+    trx_patch
+};
@@ -0,0 +1,433 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Library - Command Line Front-End
+ * ------------------------------------------------------------------ */
+
+#include "fwutils.h"
+
+/* Mapped access policy names, indexed by FW_ADVICE_* */
+static const char *fw_advice_names[] = {
+    "none",
+    "sequential",
+    "willneed",
+    "populate",
+    "hugepage"
+};
+
+/* Result names, indexed by FW_RESULT_* */
+const char *const fw_result_names[] = {
+    "correct",
+    "incorrect",
+    "error"
+};
+
+/* Get mapped access policy by name, -1 if unknown */
+int fw_advice_parse ( const char *name )
+{
+    unsigned int i;
+
+    for ( i = 0; i < sizeof ( fw_advice_names ) / sizeof ( fw_advice_names[0] ); i++ )
+    {
+        if ( !strcmp ( name, fw_advice_names[i] ) )
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* Get value of hex digit, -1 if not one */
+static int fw_hex_digit ( char c )
+{
+    if ( c >= '0' && c <= '9' )
+    {
+        return c - '0';
+    }
+
+    if ( c >= 'a' && c <= 'f' )
+    {
+        return c - 'a' + 10;
+    }
+
+    if ( c >= 'A' && c <= 'F' )
+    {
+        return c - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/* Parse offset:hexbytes patch, bytes are decoded over the hex digits */
+static int fw_patch_parse ( char *arg, struct fw_options *options )
+{
+    int hi;
+    int lo;
+    char *end;
+    size_t i;
+    size_t len;
+    unsigned char *hex;
+
+    if ( *arg < '0' || *arg > '9' )
+    {
+        return -1;
+    }
+
+    options->patch_off = strtoul ( arg, &end, 0 );
+    if ( *end != ':' )
+    {
+        return -1;
+    }
+
+    hex = ( unsigned char * ) end + 1;
+    if ( !( len = strlen ( ( char * ) hex ) ) || len % 2 )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < len / 2; i++ )
+    {
+        if ( ( hi = fw_hex_digit ( hex[2 * i] ) ) < 0
+            || ( lo = fw_hex_digit ( hex[2 * i + 1] ) ) < 0 )
+        {
+            return -1;
+        }
+
+        hex[i] = ( hi << 4 ) | lo;
+    }
+
+    options->patch = hex;
+    options->patch_len = len / 2;
+
+    return 0;
+}
+
+/* Parse command line options */
+int fw_parse_args ( int argc, char *argv[], int allowed, struct fw_options *options )
+{
+    int arg_off = 1;
+    int records = FALSE;
+
+    memset ( options, '\0', sizeof ( struct fw_options ) );
+    options->readonly = TRUE;
+    options->mode = FW_IMAGE_MAPPED;
+    options->advice = FW_ADVICE_DEFAULT;
+
+    while ( arg_off < argc && argv[arg_off][0] == '-' && argv[arg_off][1] )
+    {
+        if ( ( allowed & FW_OPT_UPDATE ) && !strcmp ( argv[arg_off], "-u" ) )
+        {
+            /* enable update mode */
+            options->readonly = FALSE;
+            arg_off++;
+
+        } else if ( ( allowed & FW_OPT_BATCH ) && !strcmp ( argv[arg_off], "-b" ) )
+        {
+            /* verify all remaining files */
+            options->batch = TRUE;
+            arg_off++;
+
+        } else if ( ( allowed & FW_OPT_BATCH ) && !strcmp ( argv[arg_off], "-l" ) )
+        {
+            /* verify files listed in a file */
+            if ( arg_off + 1 >= argc )
+            {
+                return -1;
+            }
+
+            options->list = argv[arg_off + 1];
+            options->batch = TRUE;
+            arg_off += 2;
+
+        } else if ( ( allowed & FW_OPT_BATCH ) && !strcmp ( argv[arg_off], "--cache" ) )
+        {
+            /* keep results of unchanged files */
+            if ( arg_off + 1 >= argc )
+            {
+                return -1;
+            }
+
+            options->cache = argv[arg_off + 1];
+            arg_off += 2;
+
+        } else if ( ( allowed & FW_OPT_INDEX ) && !strcmp ( argv[arg_off], "--index" ) )
+        {
+            /* combine checksums from block sidecar of each file */
+            options->index = TRUE;
+            arg_off++;
+
+        } else if ( ( allowed & FW_OPT_PATCH ) && !strcmp ( argv[arg_off], "--patch" ) )
+        {
+            /* parse patch, hex bytes are decoded in place */
+            if ( arg_off + 1 >= argc || fw_patch_parse ( argv[arg_off + 1], options ) < 0 )
+            {
+                return -1;
+            }
+
+            options->readonly = FALSE;
+            arg_off += 2;
+
+        } else if ( ( allowed & FW_OPT_SCAN ) && !strcmp ( argv[arg_off], "-f" ) )
+        {
+            /* search file for embedded headers */
+            options->scan = TRUE;
+            arg_off++;
+
+        } else if ( ( allowed & FW_OPT_FORMAT ) && !strcmp ( argv[arg_off], "--format" ) )
+        {
+            /* parse result output format */
+            if ( arg_off + 1 >= argc
+                || ( options->output = fw_output_parse ( argv[arg_off + 1] ) ) < 0 )
+            {
+                return -1;
+            }
+
+            records = TRUE;
+            arg_off += 2;
+
+        } else if ( !strcmp ( argv[arg_off], "--stats" ) )
+        {
+            /* report timing statistics to stderr */
+            options->stats = TRUE;
+            arg_off++;
+
+        } else if ( !strcmp ( argv[arg_off], "-s" ) )
+        {
+            /* read file in chunks instead of mapping it */
+            options->mode = FW_IMAGE_STREAMED;
+            arg_off++;
+
+        } else if ( !strcmp ( argv[arg_off], "-a" ) )
+        {
+            /* parse mapped access policy */
+            if ( arg_off + 1 >= argc
+                || ( options->advice = fw_advice_parse ( argv[arg_off + 1] ) ) < 0 )
+            {
+                return -1;
+            }
+
+            arg_off += 2;
+
+        } else if ( !strcmp ( argv[arg_off], "-o" ) )
+        {
+            /* parse file offset */
+            if ( arg_off + 1 >= argc || sscanf ( argv[arg_off + 1], "%lu", &options->offset ) <= 0 )
+            {
+                return -1;
+            }
+
+            arg_off += 2;
+
+        } else if ( ( allowed & FW_OPT_THREADS ) && !strcmp ( argv[arg_off], "-j" ) )
+        {
+            /* parse threads count */
+            if ( arg_off + 1 >= argc || sscanf ( argv[arg_off + 1], "%u", &options->threads ) <= 0
+                || !options->threads )
+            {
+                return -1;
+            }
+
+            arg_off += 2;
+
+        } else
+        {
+            return -1;
+        }
+    }
+
+    /* records of scan hits, or of every file given */
+    if ( records && !options->scan )
+    {
+        options->batch = TRUE;
+    }
+
+    /* batch and scan modes only verify */
+    if ( ( options->batch || options->scan ) && !options->readonly )
+    {
+        return -1;
+    }
+
+    if ( options->batch && options->scan )
+    {
+        return -1;
+    }
+
+    /* only batch verification reads and keeps results */
+    if ( options->cache && !options->batch )
+    {
+        return -1;
+    }
+
+    /* validate arguments count */
+    if ( arg_off >= argc && !options->list )
+    {
+        return -1;
+    }
+
+    options->paths = argv + arg_off;
+    options->count = options->batch ? ( unsigned int ) ( argc - arg_off ) : 1;
+
+    return 0;
+}
+
+/* Verify one file into record */
+void fw_verify ( const struct fw_format *format, const struct fw_options *options,
+    const char *path, struct fw_record *record )
+{
+    int cached;
+    size_t size;
+    struct fw_image image;
+    struct fw_cache_key key;
+
+    fw_record_init ( record, format, options, path );
+
+    if ( ( cached = fw_cache_lookup ( &key, format, options->offset, path, record ) ) > 0 )
+    {
+        return;
+    }
+
+    if ( fw_image_open ( &image, path, TRUE, options->mode, options->advice,
+            options->offset ) < 0 )
+    {
+        return;
+    }
+
+    if ( options->index && fw_index_open ( &image, path ) < 0 )
+    {
+        fw_image_close ( &image );
+        return;
+    }
+
+    record->result = format->verify ( &image, options, record );
+
+    /* streams not read up to the end have no known size */
+    size = fw_image_size ( &image );
+    record->size = size == FW_TO_END ? 0 : size;
+
+    fw_index_close ( &image );
+    fw_image_close ( &image );
+
+    if ( !cached )
+    {
+        fw_cache_store ( &key, record );
+    }
+}
+
+/* Process files one by one with format handler */
+static int fw_process ( const struct fw_format *format, const struct fw_options *options )
+{
+    int status = 0;
+    unsigned int i;
+    struct fw_image image;
+
+    for ( i = 0; i < options->count; i++ )
+    {
+        if ( fw_image_open ( &image, options->paths[i], options->readonly, options->mode,
+                options->advice, options->offset ) < 0 )
+        {
+            status = 1;
+            continue;
+        }
+
+        if ( options->index && fw_index_open ( &image, options->paths[i] ) < 0 )
+        {
+            fw_image_close ( &image );
+            status = 1;
+            continue;
+        }
+
+        if ( format->process ( &image, options ) < 0 )
+        {
+            status = 1;
+        }
+
+        fw_index_close ( &image );
+        fw_image_close ( &image );
+    }
+
+    return status;
+}
+
+/* Patch bytes into files, format handler carries the checksums over */
+static int fw_patch ( const struct fw_format *format, const struct fw_options *options )
+{
+    int status = 0;
+    unsigned int i;
+    struct fw_image image;
+
+    if ( !format->patch )
+    {
+        fprintf ( stderr, "Error: patching is not supported for %s images\n", format->name );
+        return 1;
+    }
+
+    for ( i = 0; i < options->count; i++ )
+    {
+        if ( fw_image_open ( &image, options->paths[i], FALSE, options->mode, options->advice,
+                options->offset ) < 0 )
+        {
+            status = 1;
+            continue;
+        }
+
+        /* patched blocks are rehashed, the rest of the index is kept */
+        if ( options->index && fw_index_open ( &image, options->paths[i] ) < 0 )
+        {
+            fw_image_close ( &image );
+            status = 1;
+            continue;
+        }
+
+        if ( format->patch ( &image, options ) < 0 )
+        {
+            status = 1;
+        }
+
+        fw_index_close ( &image );
+        fw_image_close ( &image );
+    }
+
+    return status;
+}
+
+/* Process files with format handler */
+int fw_run ( const struct fw_format *format, const struct fw_options *options )
+{
+    int status;
+
+    if ( options->stats )
+    {
+        fw_stats_start (  );
+    }
+
+    /* go on without the cache if it cannot be used */
+    if ( options->cache )
+    {
+        fw_cache_open ( options->cache );
+    }
+
+    if ( options->batch )
+    {
+        status = fw_batch ( format, options );
+
+    } else if ( options->scan )
+    {
+        status = fw_scan ( format, options );
+
+    } else if ( options->patch )
+    {
+        status = fw_patch ( format, options );
+
+    } else
+    {
+        status = fw_process ( format, options );
+    }
+
+    fw_cache_close (  );
+
+    if ( options->stats )
+    {
+        fw_stats_report ( options->output, options->scan );
+    }
+
+    return status;
+}
@@ -33,6 +33,8 @@
  ***********************************************************************
  */
 
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include "md5.h"
 
@@ -48,9 +50,15 @@
  */
 
 /* forward declaration */
-static void Transform (  );
+static void Transform ( UINT4 * buf, const UINT4 * in );
+static void md5_blocks_ref ( UINT4 * buf, const unsigned char *data, size_t nblocks );
+static void md5_engine_init ( void );
 
-static unsigned char PADDING[64] = {
+static MD5_BLOCKS md5_blocks_fn;
+static const char *md5_engine_name;
+static pthread_once_t md5_engine_once = PTHREAD_ONCE_INIT;
+
+static const unsigned char PADDING[64] = {
     0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -99,11 +107,19 @@ static unsigned char PADDING[64] = {
 #define UL(x)	x
 #endif
 
+/* DECODE packs n little-endian bytes from src into 32-bit words */
+#define DECODE(dst, src, n) \
+  {unsigned int i_, ii_; \
+   for (i_ = 0, ii_ = 0; i_ < (n); i_++, ii_ += 4) \
+     (dst)[i_] = (((UINT4)(src)[ii_ + 3]) << 24) | \
+       (((UINT4)(src)[ii_ + 2]) << 16) | \
+       (((UINT4)(src)[ii_ + 1]) << 8) | ((UINT4)(src)[ii_]); \
+  }
+
 /* The routine MD5_Init initializes the message-digest context
    mdContext. All fields are set to zero.
  */
-void MD5_Init ( mdContext )
-     MD5_CTX *mdContext;
+void MD5_Init ( MD5_CTX * mdContext )
 {
     mdContext->i[0] = mdContext->i[1] = ( UINT4 ) 0;
 
@@ -115,75 +131,90 @@ void MD5_Init ( mdContext )
     mdContext->buf[3] = ( UINT4 ) 0x10325476;
 }
 
-/* The routine MD5Update updates the message-digest context to
-   account for the presence of each of the characters inBuf[0..inLen-1]
-   in the message whose digest is being computed.
- */
-void MD5_Update ( mdContext, inBuf, inLen )
-     MD5_CTX *mdContext;
-     unsigned char *inBuf;
-     unsigned int inLen;
+/* Update context with block function fn, see MD5_Update */
+static void md5_update ( MD5_BLOCKS fn, MD5_CTX * mdContext, const void *inBuf,
+    size_t inLen )
 {
-    UINT4 in[16];
-    int mdi;
-    unsigned int i, ii;
+    const unsigned char *inPtr = ( const unsigned char * ) inBuf;
+    unsigned int mdi;
+    unsigned int fill;
 
     /* compute number of bytes mod 64 */
-    mdi = ( int ) ( ( mdContext->i[0] >> 3 ) & 0x3F );
+    mdi = ( unsigned int ) ( ( mdContext->i[0] >> 3 ) & 0x3F );
 
     /* update number of bits */
-    if ( ( mdContext->i[0] + ( ( UINT4 ) inLen << 3 ) ) < mdContext->i[0] )
+    if ( ( UINT4 ) ( mdContext->i[0] + ( ( UINT4 ) inLen << 3 ) ) < mdContext->i[0] )
         mdContext->i[1]++;
     mdContext->i[0] += ( ( UINT4 ) inLen << 3 );
-    mdContext->i[1] += ( ( UINT4 ) inLen >> 29 );
+    mdContext->i[1] += ( UINT4 ) ( ( unsigned long long ) inLen >> 29 );
 
-    while ( inLen-- )
+    /* complete a partially filled block first */
+    if ( mdi )
     {
-        /* add new character to buffer, increment mdi */
-        mdContext->in[mdi++] = *inBuf++;
-
-        /* transform if necessary */
-        if ( mdi == 0x40 )
+        fill = 0x40 - mdi;
+        if ( inLen < fill )
         {
-            for ( i = 0, ii = 0; i < 16; i++, ii += 4 )
-                in[i] = ( ( ( UINT4 ) mdContext->in[ii + 3] ) << 24 ) |
-                    ( ( ( UINT4 ) mdContext->in[ii + 2] ) << 16 ) |
-                    ( ( ( UINT4 ) mdContext->in[ii + 1] ) << 8 ) | ( ( UINT4 ) mdContext->in[ii] );
-            Transform ( mdContext->buf, in );
-            mdi = 0;
+            memcpy ( mdContext->in + mdi, inPtr, inLen );
+            return;
         }
+        memcpy ( mdContext->in + mdi, inPtr, fill );
+        fn ( mdContext->buf, mdContext->in, 1 );
+        inPtr += fill;
+        inLen -= fill;
+    }
+
+    /* transform whole blocks without copying them */
+    if ( inLen >= 0x40 )
+    {
+        fn ( mdContext->buf, inPtr, inLen >> 6 );
+        inPtr += inLen & ~( size_t ) 0x3F;
+        inLen &= 0x3F;
     }
+
+    /* keep the tail for the next call */
+    memcpy ( mdContext->in, inPtr, inLen );
 }
 
-/* The routine MD5Final terminates the message-digest computation and
-   ends with the desired message digest in mdContext->digest[0...15].
+/* The routine MD5Update updates the message-digest context to
+   account for the presence of each of the characters inBuf[0..inLen-1]
+   in the message whose digest is being computed. Whole blocks are
+   transformed straight from inBuf, only a partial head and tail are
+   kept in mdContext->in.
  */
-void MD5_Final ( hash, mdContext )
-     unsigned char hash[];
-     MD5_CTX *mdContext;
+void MD5_Update ( MD5_CTX * mdContext, const void *inBuf, size_t inLen )
 {
-    UINT4 in[16];
+    md5_engine_init (  );
+    md5_update ( md5_blocks_fn, mdContext, inBuf, inLen );
+}
+
+/* Finish context with block function fn, see MD5_Final */
+static void md5_final ( MD5_BLOCKS fn, unsigned char hash[], MD5_CTX * mdContext )
+{
+    UINT4 bits[2];
     int mdi;
     unsigned int i, ii;
     unsigned int padLen;
 
     /* save number of bits */
-    in[14] = mdContext->i[0];
-    in[15] = mdContext->i[1];
+    bits[0] = mdContext->i[0];
+    bits[1] = mdContext->i[1];
 
     /* compute number of bytes mod 64 */
     mdi = ( int ) ( ( mdContext->i[0] >> 3 ) & 0x3F );
 
     /* pad out to 56 mod 64 */
     padLen = ( mdi < 56 ) ? ( 56 - mdi ) : ( 120 - mdi );
-    MD5_Update ( mdContext, PADDING, padLen );
+    md5_update ( fn, mdContext, PADDING, padLen );
 
     /* append length in bits and transform */
-    for ( i = 0, ii = 0; i < 14; i++, ii += 4 )
-        in[i] = ( ( ( UINT4 ) mdContext->in[ii + 3] ) << 24 ) |
-            ( ( ( UINT4 ) mdContext->in[ii + 2] ) << 16 ) |
-            ( ( ( UINT4 ) mdContext->in[ii + 1] ) << 8 ) | ( ( UINT4 ) mdContext->in[ii] );
-    Transform ( mdContext->buf, in );
+    for ( i = 0, ii = 56; i < 2; i++, ii += 4 )
+    {
+        mdContext->in[ii] = ( unsigned char ) ( bits[i] & 0xFF );
+        mdContext->in[ii + 1] = ( unsigned char ) ( ( bits[i] >> 8 ) & 0xFF );
+        mdContext->in[ii + 2] = ( unsigned char ) ( ( bits[i] >> 16 ) & 0xFF );
+        mdContext->in[ii + 3] = ( unsigned char ) ( ( bits[i] >> 24 ) & 0xFF );
+    }
+    fn ( mdContext->buf, mdContext->in, 1 );
 
     /* store buffer in digest */
     for ( i = 0, ii = 0; i < 4; i++, ii += 4 )
@@ -196,11 +227,18 @@ void MD5_Final ( hash, mdContext )
     memcpy ( hash, mdContext->digest, 16 );
 }
 
+/* The routine MD5Final terminates the message-digest computation and
+   ends with the desired message digest in mdContext->digest[0...15].
+ */
+void MD5_Final ( unsigned char hash[], MD5_CTX * mdContext )
+{
+    md5_engine_init (  );
+    md5_final ( md5_blocks_fn, hash, mdContext );
+}
+
 /* Basic MD5 step. Transforms buf based on in.
  */
-static void Transform ( buf, in )
-     UINT4 *buf;
-     UINT4 *in;
+static void Transform ( UINT4 * buf, const UINT4 * in )
 {
     UINT4 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
 
@@ -298,6 +336,311 @@ static void Transform ( buf, in )
     buf[3] += d;
 }
 
+/* The routine MD5_Save captures the midstate of mdContext so that
+   hashing can later resume from it with MD5_Restore, skipping the
+   compression of everything hashed so far. Only whole blocks can be
+   captured, returns -1 if input is still buffered in the context.
+ */
+int MD5_Save ( const MD5_CTX * mdContext, MD5_STATE * state )
+{
+    if ( mdContext->i[0] & 0x1FF )
+    {
+        return -1;
+    }
+
+    state->i[0] = mdContext->i[0];
+    state->i[1] = mdContext->i[1];
+    memcpy ( state->buf, mdContext->buf, sizeof ( state->buf ) );
+    return 0;
+}
+
+/* The routine MD5_Restore resumes mdContext from a saved midstate.
+ */
+void MD5_Restore ( MD5_CTX * mdContext, const MD5_STATE * state )
+{
+    mdContext->i[0] = state->i[0];
+    mdContext->i[1] = state->i[1];
+    memcpy ( mdContext->buf, state->buf, sizeof ( mdContext->buf ) );
+}
+
+/* The routine MD5_Serialize stores a midstate into MD5_STATE_SIZE
+   bytes, the bit count followed by the chaining state, every word
+   little-endian, so it reads back the same on any host.
+ */
+void MD5_Serialize ( const MD5_STATE * state, unsigned char out[] )
+{
+    unsigned int i;
+    UINT4 word;
+
+    for ( i = 0; i < 6; i++ )
+    {
+        word = i < 2 ? state->i[i] : state->buf[i - 2];
+        out[4 * i] = ( unsigned char ) word;
+        out[4 * i + 1] = ( unsigned char ) ( word >> 8 );
+        out[4 * i + 2] = ( unsigned char ) ( word >> 16 );
+        out[4 * i + 3] = ( unsigned char ) ( word >> 24 );
+    }
+}
+
+/* The routine MD5_Deserialize loads a midstate stored by MD5_Serialize.
+ */
+void MD5_Deserialize ( MD5_STATE * state, const unsigned char in[] )
+{
+    DECODE ( state->i, in, 2 );
+    DECODE ( state->buf, in + 8, 4 );
+}
+
+/* Reference block function, byte-packs each block for Transform */
+static void md5_blocks_ref ( UINT4 * buf, const unsigned char *data, size_t nblocks )
+{
+    UINT4 in[16];
+
+    for ( ; nblocks; nblocks--, data += 0x40 )
+    {
+        DECODE ( in, data, 16 );
+        Transform ( buf, in );
+    }
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+/* F1 and G1 are F and G with one operation less, same truth table */
+#define F1(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define G1(x, y, z) ((y) ^ ((z) & ((x) ^ (y))))
+#define H1(x, y, z) ((x) ^ (y) ^ (z))
+#define I1(x, y, z) ((y) ^ ((x) | ~(z)))
+
+#define STEP(f, a, b, c, d, x, s, ac) \
+  {(a) += f ((b), (c), (d)) + (x) + (UINT4)(ac); \
+   (a) = ROTATE_LEFT ((a), (s)) + (b); \
+  }
+
+/* Little-endian block function. Loads input words natively instead of
+   packing them byte by byte, then runs the same 64 steps as Transform.
+ */
+static void md5_blocks_le ( UINT4 * buf, const unsigned char *data, size_t nblocks )
+{
+    UINT4 a, b, c, d;
+    UINT4 x[16];
+
+    for ( ; nblocks; nblocks--, data += 0x40 )
+    {
+        memcpy ( x, data, sizeof ( x ) );
+        a = buf[0];
+        b = buf[1];
+        c = buf[2];
+        d = buf[3];
+
+        /* Round 1 */
+        STEP ( F1, a, b, c, d, x[0], S11, 0xd76aa478 );
+        STEP ( F1, d, a, b, c, x[1], S12, 0xe8c7b756 );
+        STEP ( F1, c, d, a, b, x[2], S13, 0x242070db );
+        STEP ( F1, b, c, d, a, x[3], S14, 0xc1bdceee );
+        STEP ( F1, a, b, c, d, x[4], S11, 0xf57c0faf );
+        STEP ( F1, d, a, b, c, x[5], S12, 0x4787c62a );
+        STEP ( F1, c, d, a, b, x[6], S13, 0xa8304613 );
+        STEP ( F1, b, c, d, a, x[7], S14, 0xfd469501 );
+        STEP ( F1, a, b, c, d, x[8], S11, 0x698098d8 );
+        STEP ( F1, d, a, b, c, x[9], S12, 0x8b44f7af );
+        STEP ( F1, c, d, a, b, x[10], S13, 0xffff5bb1 );
+        STEP ( F1, b, c, d, a, x[11], S14, 0x895cd7be );
+        STEP ( F1, a, b, c, d, x[12], S11, 0x6b901122 );
+        STEP ( F1, d, a, b, c, x[13], S12, 0xfd987193 );
+        STEP ( F1, c, d, a, b, x[14], S13, 0xa679438e );
+        STEP ( F1, b, c, d, a, x[15], S14, 0x49b40821 );
+
+        /* Round 2 */
+        STEP ( G1, a, b, c, d, x[1], S21, 0xf61e2562 );
+        STEP ( G1, d, a, b, c, x[6], S22, 0xc040b340 );
+        STEP ( G1, c, d, a, b, x[11], S23, 0x265e5a51 );
+        STEP ( G1, b, c, d, a, x[0], S24, 0xe9b6c7aa );
+        STEP ( G1, a, b, c, d, x[5], S21, 0xd62f105d );
+        STEP ( G1, d, a, b, c, x[10], S22, 0x02441453 );
+        STEP ( G1, c, d, a, b, x[15], S23, 0xd8a1e681 );
+        STEP ( G1, b, c, d, a, x[4], S24, 0xe7d3fbc8 );
+        STEP ( G1, a, b, c, d, x[9], S21, 0x21e1cde6 );
+        STEP ( G1, d, a, b, c, x[14], S22, 0xc33707d6 );
+        STEP ( G1, c, d, a, b, x[3], S23, 0xf4d50d87 );
+        STEP ( G1, b, c, d, a, x[8], S24, 0x455a14ed );
+        STEP ( G1, a, b, c, d, x[13], S21, 0xa9e3e905 );
+        STEP ( G1, d, a, b, c, x[2], S22, 0xfcefa3f8 );
+        STEP ( G1, c, d, a, b, x[7], S23, 0x676f02d9 );
+        STEP ( G1, b, c, d, a, x[12], S24, 0x8d2a4c8a );
+
+        /* Round 3 */
+        STEP ( H1, a, b, c, d, x[5], S31, 0xfffa3942 );
+        STEP ( H1, d, a, b, c, x[8], S32, 0x8771f681 );
+        STEP ( H1, c, d, a, b, x[11], S33, 0x6d9d6122 );
+        STEP ( H1, b, c, d, a, x[14], S34, 0xfde5380c );
+        STEP ( H1, a, b, c, d, x[1], S31, 0xa4beea44 );
+        STEP ( H1, d, a, b, c, x[4], S32, 0x4bdecfa9 );
+        STEP ( H1, c, d, a, b, x[7], S33, 0xf6bb4b60 );
+        STEP ( H1, b, c, d, a, x[10], S34, 0xbebfbc70 );
+        STEP ( H1, a, b, c, d, x[13], S31, 0x289b7ec6 );
+        STEP ( H1, d, a, b, c, x[0], S32, 0xeaa127fa );
+        STEP ( H1, c, d, a, b, x[3], S33, 0xd4ef3085 );
+        STEP ( H1, b, c, d, a, x[6], S34, 0x04881d05 );
+        STEP ( H1, a, b, c, d, x[9], S31, 0xd9d4d039 );
+        STEP ( H1, d, a, b, c, x[12], S32, 0xe6db99e5 );
+        STEP ( H1, c, d, a, b, x[15], S33, 0x1fa27cf8 );
+        STEP ( H1, b, c, d, a, x[2], S34, 0xc4ac5665 );
+
+        /* Round 4 */
+        STEP ( I1, a, b, c, d, x[0], S41, 0xf4292244 );
+        STEP ( I1, d, a, b, c, x[7], S42, 0x432aff97 );
+        STEP ( I1, c, d, a, b, x[14], S43, 0xab9423a7 );
+        STEP ( I1, b, c, d, a, x[5], S44, 0xfc93a039 );
+        STEP ( I1, a, b, c, d, x[12], S41, 0x655b59c3 );
+        STEP ( I1, d, a, b, c, x[3], S42, 0x8f0ccc92 );
+        STEP ( I1, c, d, a, b, x[10], S43, 0xffeff47d );
+        STEP ( I1, b, c, d, a, x[1], S44, 0x85845dd1 );
+        STEP ( I1, a, b, c, d, x[8], S41, 0x6fa87e4f );
+        STEP ( I1, d, a, b, c, x[15], S42, 0xfe2ce6e0 );
+        STEP ( I1, c, d, a, b, x[6], S43, 0xa3014314 );
+        STEP ( I1, b, c, d, a, x[13], S44, 0x4e0811a1 );
+        STEP ( I1, a, b, c, d, x[4], S41, 0xf7537e82 );
+        STEP ( I1, d, a, b, c, x[11], S42, 0xbd3af235 );
+        STEP ( I1, c, d, a, b, x[2], S43, 0x2ad7d2bb );
+        STEP ( I1, b, c, d, a, x[9], S44, 0xeb86d391 );
+
+        buf[0] += a;
+        buf[1] += b;
+        buf[2] += c;
+        buf[3] += d;
+    }
+}
+
+#endif
+
+#ifdef MD5_ASM
+/* Hand-scheduled x86-64 block function, see md5-x86_64.S */
+extern void md5_block_x86_64 ( UINT4 * buf, const unsigned char *data, size_t nblocks );
+#endif
+
+/* RFC 1321 test suite, the last one spans two blocks */
+static const struct
+{
+    const char *msg;
+    unsigned char digest[16];
+} md5_kat[] = {
+    {"", {0xd4, 0x1d, 0x8c, 0xd9, 0x8f, 0x00, 0xb2, 0x04,
+            0xe9, 0x80, 0x09, 0x98, 0xec, 0xf8, 0x42, 0x7e}},
+    {"abc", {0x90, 0x01, 0x50, 0x98, 0x3c, 0xd2, 0x4f, 0xb0,
+            0xd6, 0x96, 0x3f, 0x7d, 0x28, 0xe1, 0x7f, 0x72}},
+    {"message digest", {0xf9, 0x6b, 0x69, 0x7d, 0x7c, 0xb7, 0x93, 0x8d,
+            0x52, 0x5a, 0x2f, 0x31, 0xaa, 0xf1, 0x61, 0xd0}},
+    {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+        {0x57, 0xed, 0xf4, 0xa2, 0x2b, 0xe3, 0xc9, 0x55,
+            0xac, 0x49, 0xda, 0x2e, 0x21, 0x07, 0xb6, 0x7a}}
+};
+
+/* Check block function fn against the RFC 1321 test suite */
+static int md5_selftest ( MD5_BLOCKS fn )
+{
+    unsigned int i;
+    MD5_CTX ctx;
+    unsigned char digest[16];
+
+    for ( i = 0; i < sizeof ( md5_kat ) / sizeof ( md5_kat[0] ); i++ )
+    {
+        MD5_Init ( &ctx );
+        md5_update ( fn, &ctx, md5_kat[i].msg, strlen ( md5_kat[i].msg ) );
+        md5_final ( fn, digest, &ctx );
+
+        if ( memcmp ( digest, md5_kat[i].digest, sizeof ( digest ) ) )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* The routine MD5_SelfTest checks the selected block function against
+   the RFC 1321 test suite. Returns 0 on success, -1 on mismatch.
+ */
+int MD5_SelfTest ( void )
+{
+    md5_engine_init (  );
+    return md5_selftest ( md5_blocks_fn );
+}
+
+/* Block functions, fastest first */
+static const MD5_ENGINE md5_engines[] = {
+#ifdef MD5_ASM
+    {md5_block_x86_64, "x86_64-asm"},
+#endif
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    {md5_blocks_le, "native-le"},
+#endif
+    {md5_blocks_ref, "reference"}
+};
+
+#define MD5_ENGINES (sizeof ( md5_engines ) / sizeof ( md5_engines[0] ))
+
+/* Select the fastest block function passing the self-test, the
+   reference Transform is kept as the last resort. Candidates are
+   published only once they passed.
+ */
+static void md5_engine_setup ( void )
+{
+    unsigned int i;
+
+    for ( i = 0; i < MD5_ENGINES; i++ )
+    {
+        if ( !md5_selftest ( md5_engines[i].fn ) )
+        {
+            md5_engine_name = md5_engines[i].name;
+            md5_blocks_fn = md5_engines[i].fn;
+            return;
+        }
+    }
+
+    /* nothing passed, stay with the reference anyway */
+    md5_engine_name = "reference";
+    md5_blocks_fn = md5_blocks_ref;
+}
+
+/* Set block function up once, callers on other threads wait until it is done */
+static void md5_engine_init ( void )
+{
+    pthread_once ( &md5_engine_once, md5_engine_setup );
+}
+
+/* The routine MD5_Engine names the block function in use.
+ */
+const char *MD5_Engine ( void )
+{
+    md5_engine_init (  );
+    return md5_engine_name;
+}
+
+/* The routine MD5_Engines lists every block function built in, fastest
+   first and the reference Transform last. Returns their count.
+ */
+unsigned int MD5_Engines ( const MD5_ENGINE ** engines )
+{
+    *engines = md5_engines;
+    return MD5_ENGINES;
+}
+
+/* The routine MD5_Update_Engine is MD5_Update hashing with the block
+   function of engine instead of the selected one.
+ */
+void MD5_Update_Engine ( const MD5_ENGINE * engine, MD5_CTX * mdContext, const void *inBuf,
+    size_t inLen )
+{
+    md5_update ( engine->fn, mdContext, inBuf, inLen );
+}
+
+/* The routine MD5_Final_Engine is MD5_Final hashing with the block
+   function of engine instead of the selected one.
+ */
+void MD5_Final_Engine ( const MD5_ENGINE * engine, unsigned char hash[], MD5_CTX * mdContext )
+{
+    md5_final ( engine->fn, hash, mdContext );
+}
+
 /*
  ***********************************************************************
  ** End of md5.c                                                      **
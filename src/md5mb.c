@@ -0,0 +1,497 @@
+/* ------------------------------------------------------------------
+ * Multi-Buffer MD5 - Lockstep Hashing of Independent Messages
+ * ------------------------------------------------------------------ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "md5.h"
+
+/*
+ * MD5 is strictly sequential within one message, but the same step can
+ * be applied to several messages at once. Each SIMD lane carries the
+ * state of one message: 4 lanes with SSE2, 8 lanes with AVX2. Partial
+ * head and tail blocks go through MD5_Update, only whole blocks run in
+ * lockstep. When lanes run dry they are refilled from the remaining
+ * messages, the last lone message finishes on the scalar engine.
+ */
+
+#define S11 7
+#define S12 12
+#define S13 17
+#define S14 22
+#define S21 5
+#define S22 9
+#define S23 14
+#define S24 20
+#define S31 4
+#define S32 11
+#define S33 16
+#define S34 23
+#define S41 6
+#define S42 10
+#define S43 15
+#define S44 21
+
+#define MB_MAX_LANES 8
+
+/* Message waiting for or occupying a lane */
+struct md5_mb_msg
+{
+    MD5_CTX *ctx;
+    const unsigned char *data;
+    size_t blocks;
+};
+
+/* Boolean functions and step written against the MB_V* vector ops */
+#define MB_F(x, y, z) MB_VXOR ((z), MB_VAND ((x), MB_VXOR ((y), (z))))
+#define MB_G(x, y, z) MB_VXOR ((y), MB_VAND ((z), MB_VXOR ((x), (y))))
+#define MB_H(x, y, z) MB_VXOR (MB_VXOR ((x), (y)), (z))
+#define MB_I(x, y, z) MB_VXOR ((y), MB_VOR ((x), MB_VXOR ((z), ones)))
+
+#define MB_STEP(f, a, b, c, d, x, s, ac) \
+  {(a) = MB_VADD (MB_VADD ((a), f ((b), (c), (d))), \
+       MB_VADD ((x), MB_VSET1 ((int) (ac)))); \
+   (a) = MB_VADD (MB_VROL ((a), (s)), (b)); \
+  }
+
+#define MB_ROUNDS \
+    MB_STEP ( MB_F, a, b, c, d, x[0], S11, 0xd76aa478 ); \
+    MB_STEP ( MB_F, d, a, b, c, x[1], S12, 0xe8c7b756 ); \
+    MB_STEP ( MB_F, c, d, a, b, x[2], S13, 0x242070db ); \
+    MB_STEP ( MB_F, b, c, d, a, x[3], S14, 0xc1bdceee ); \
+    MB_STEP ( MB_F, a, b, c, d, x[4], S11, 0xf57c0faf ); \
+    MB_STEP ( MB_F, d, a, b, c, x[5], S12, 0x4787c62a ); \
+    MB_STEP ( MB_F, c, d, a, b, x[6], S13, 0xa8304613 ); \
+    MB_STEP ( MB_F, b, c, d, a, x[7], S14, 0xfd469501 ); \
+    MB_STEP ( MB_F, a, b, c, d, x[8], S11, 0x698098d8 ); \
+    MB_STEP ( MB_F, d, a, b, c, x[9], S12, 0x8b44f7af ); \
+    MB_STEP ( MB_F, c, d, a, b, x[10], S13, 0xffff5bb1 ); \
+    MB_STEP ( MB_F, b, c, d, a, x[11], S14, 0x895cd7be ); \
+    MB_STEP ( MB_F, a, b, c, d, x[12], S11, 0x6b901122 ); \
+    MB_STEP ( MB_F, d, a, b, c, x[13], S12, 0xfd987193 ); \
+    MB_STEP ( MB_F, c, d, a, b, x[14], S13, 0xa679438e ); \
+    MB_STEP ( MB_F, b, c, d, a, x[15], S14, 0x49b40821 ); \
+    MB_STEP ( MB_G, a, b, c, d, x[1], S21, 0xf61e2562 ); \
+    MB_STEP ( MB_G, d, a, b, c, x[6], S22, 0xc040b340 ); \
+    MB_STEP ( MB_G, c, d, a, b, x[11], S23, 0x265e5a51 ); \
+    MB_STEP ( MB_G, b, c, d, a, x[0], S24, 0xe9b6c7aa ); \
+    MB_STEP ( MB_G, a, b, c, d, x[5], S21, 0xd62f105d ); \
+    MB_STEP ( MB_G, d, a, b, c, x[10], S22, 0x02441453 ); \
+    MB_STEP ( MB_G, c, d, a, b, x[15], S23, 0xd8a1e681 ); \
+    MB_STEP ( MB_G, b, c, d, a, x[4], S24, 0xe7d3fbc8 ); \
+    MB_STEP ( MB_G, a, b, c, d, x[9], S21, 0x21e1cde6 ); \
+    MB_STEP ( MB_G, d, a, b, c, x[14], S22, 0xc33707d6 ); \
+    MB_STEP ( MB_G, c, d, a, b, x[3], S23, 0xf4d50d87 ); \
+    MB_STEP ( MB_G, b, c, d, a, x[8], S24, 0x455a14ed ); \
+    MB_STEP ( MB_G, a, b, c, d, x[13], S21, 0xa9e3e905 ); \
+    MB_STEP ( MB_G, d, a, b, c, x[2], S22, 0xfcefa3f8 ); \
+    MB_STEP ( MB_G, c, d, a, b, x[7], S23, 0x676f02d9 ); \
+    MB_STEP ( MB_G, b, c, d, a, x[12], S24, 0x8d2a4c8a ); \
+    MB_STEP ( MB_H, a, b, c, d, x[5], S31, 0xfffa3942 ); \
+    MB_STEP ( MB_H, d, a, b, c, x[8], S32, 0x8771f681 ); \
+    MB_STEP ( MB_H, c, d, a, b, x[11], S33, 0x6d9d6122 ); \
+    MB_STEP ( MB_H, b, c, d, a, x[14], S34, 0xfde5380c ); \
+    MB_STEP ( MB_H, a, b, c, d, x[1], S31, 0xa4beea44 ); \
+    MB_STEP ( MB_H, d, a, b, c, x[4], S32, 0x4bdecfa9 ); \
+    MB_STEP ( MB_H, c, d, a, b, x[7], S33, 0xf6bb4b60 ); \
+    MB_STEP ( MB_H, b, c, d, a, x[10], S34, 0xbebfbc70 ); \
+    MB_STEP ( MB_H, a, b, c, d, x[13], S31, 0x289b7ec6 ); \
+    MB_STEP ( MB_H, d, a, b, c, x[0], S32, 0xeaa127fa ); \
+    MB_STEP ( MB_H, c, d, a, b, x[3], S33, 0xd4ef3085 ); \
+    MB_STEP ( MB_H, b, c, d, a, x[6], S34, 0x04881d05 ); \
+    MB_STEP ( MB_H, a, b, c, d, x[9], S31, 0xd9d4d039 ); \
+    MB_STEP ( MB_H, d, a, b, c, x[12], S32, 0xe6db99e5 ); \
+    MB_STEP ( MB_H, c, d, a, b, x[15], S33, 0x1fa27cf8 ); \
+    MB_STEP ( MB_H, b, c, d, a, x[2], S34, 0xc4ac5665 ); \
+    MB_STEP ( MB_I, a, b, c, d, x[0], S41, 0xf4292244 ); \
+    MB_STEP ( MB_I, d, a, b, c, x[7], S42, 0x432aff97 ); \
+    MB_STEP ( MB_I, c, d, a, b, x[14], S43, 0xab9423a7 ); \
+    MB_STEP ( MB_I, b, c, d, a, x[5], S44, 0xfc93a039 ); \
+    MB_STEP ( MB_I, a, b, c, d, x[12], S41, 0x655b59c3 ); \
+    MB_STEP ( MB_I, d, a, b, c, x[3], S42, 0x8f0ccc92 ); \
+    MB_STEP ( MB_I, c, d, a, b, x[10], S43, 0xffeff47d ); \
+    MB_STEP ( MB_I, b, c, d, a, x[1], S44, 0x85845dd1 ); \
+    MB_STEP ( MB_I, a, b, c, d, x[8], S41, 0x6fa87e4f ); \
+    MB_STEP ( MB_I, d, a, b, c, x[15], S42, 0xfe2ce6e0 ); \
+    MB_STEP ( MB_I, c, d, a, b, x[6], S43, 0xa3014314 ); \
+    MB_STEP ( MB_I, b, c, d, a, x[13], S44, 0x4e0811a1 ); \
+    MB_STEP ( MB_I, a, b, c, d, x[4], S41, 0xf7537e82 ); \
+    MB_STEP ( MB_I, d, a, b, c, x[11], S42, 0xbd3af235 ); \
+    MB_STEP ( MB_I, c, d, a, b, x[2], S43, 0x2ad7d2bb ); \
+    MB_STEP ( MB_I, b, c, d, a, x[9], S44, 0xeb86d391 );
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+#include <immintrin.h>
+
+#define MB_VADD(x, y) _mm_add_epi32 ((x), (y))
+#define MB_VXOR(x, y) _mm_xor_si128 ((x), (y))
+#define MB_VAND(x, y) _mm_and_si128 ((x), (y))
+#define MB_VOR(x, y) _mm_or_si128 ((x), (y))
+#define MB_VSET1(x) _mm_set1_epi32 (x)
+#define MB_VROL(x, n) MB_VOR (_mm_slli_epi32 ((x), (n)), _mm_srli_epi32 ((x), 32 - (n)))
+
+/* Four lanes with SSE2 */
+__attribute__ ( ( target ( "sse2" ) ) )
+static void md5_mb_x4 ( UINT4 * state[], const unsigned char *data[], size_t nblocks )
+{
+    unsigned int g;
+    __m128i a, b, c, d, aa, bb, cc, dd;
+    __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+    __m128i x[16];
+    const __m128i ones = _mm_set1_epi32 ( -1 );
+    UINT4 out[4][4] __attribute__ ( ( aligned ( 16 ) ) );
+
+    a = _mm_set_epi32 ( state[3][0], state[2][0], state[1][0], state[0][0] );
+    b = _mm_set_epi32 ( state[3][1], state[2][1], state[1][1], state[0][1] );
+    c = _mm_set_epi32 ( state[3][2], state[2][2], state[1][2], state[0][2] );
+    d = _mm_set_epi32 ( state[3][3], state[2][3], state[1][3], state[0][3] );
+
+    for ( ; nblocks; nblocks-- )
+    {
+        /* transpose 4x4 word groups so that x[k] holds word k of every lane */
+        for ( g = 0; g < 4; g++ )
+        {
+            r0 = _mm_loadu_si128 ( ( const __m128i * ) ( data[0] + 16 * g ) );
+            r1 = _mm_loadu_si128 ( ( const __m128i * ) ( data[1] + 16 * g ) );
+            r2 = _mm_loadu_si128 ( ( const __m128i * ) ( data[2] + 16 * g ) );
+            r3 = _mm_loadu_si128 ( ( const __m128i * ) ( data[3] + 16 * g ) );
+            t0 = _mm_unpacklo_epi32 ( r0, r1 );
+            t1 = _mm_unpacklo_epi32 ( r2, r3 );
+            t2 = _mm_unpackhi_epi32 ( r0, r1 );
+            t3 = _mm_unpackhi_epi32 ( r2, r3 );
+            x[4 * g + 0] = _mm_unpacklo_epi64 ( t0, t1 );
+            x[4 * g + 1] = _mm_unpackhi_epi64 ( t0, t1 );
+            x[4 * g + 2] = _mm_unpacklo_epi64 ( t2, t3 );
+            x[4 * g + 3] = _mm_unpackhi_epi64 ( t2, t3 );
+        }
+
+        aa = a;
+        bb = b;
+        cc = c;
+        dd = d;
+
+        MB_ROUNDS;
+
+        a = _mm_add_epi32 ( a, aa );
+        b = _mm_add_epi32 ( b, bb );
+        c = _mm_add_epi32 ( c, cc );
+        d = _mm_add_epi32 ( d, dd );
+
+        for ( g = 0; g < 4; g++ )
+        {
+            data[g] += 64;
+        }
+    }
+
+    _mm_store_si128 ( ( __m128i * ) out[0], a );
+    _mm_store_si128 ( ( __m128i * ) out[1], b );
+    _mm_store_si128 ( ( __m128i * ) out[2], c );
+    _mm_store_si128 ( ( __m128i * ) out[3], d );
+
+    for ( g = 0; g < 4; g++ )
+    {
+        state[g][0] = out[0][g];
+        state[g][1] = out[1][g];
+        state[g][2] = out[2][g];
+        state[g][3] = out[3][g];
+    }
+}
+
+#undef MB_VADD
+#undef MB_VXOR
+#undef MB_VAND
+#undef MB_VOR
+#undef MB_VSET1
+#undef MB_VROL
+
+#define MB_VADD(x, y) _mm256_add_epi32 ((x), (y))
+#define MB_VXOR(x, y) _mm256_xor_si256 ((x), (y))
+#define MB_VAND(x, y) _mm256_and_si256 ((x), (y))
+#define MB_VOR(x, y) _mm256_or_si256 ((x), (y))
+#define MB_VSET1(x) _mm256_set1_epi32 (x)
+#define MB_VROL(x, n) MB_VOR (_mm256_slli_epi32 ((x), (n)), _mm256_srli_epi32 ((x), 32 - (n)))
+
+/* Eight lanes with AVX2 */
+__attribute__ ( ( target ( "avx2" ) ) )
+static void md5_mb_x8 ( UINT4 * state[], const unsigned char *data[], size_t nblocks )
+{
+    unsigned int g;
+    __m256i a, b, c, d, aa, bb, cc, dd;
+    __m256i r[8], t[8], u[8];
+    __m256i x[16];
+    const __m256i ones = _mm256_set1_epi32 ( -1 );
+    UINT4 out[4][8] __attribute__ ( ( aligned ( 32 ) ) );
+
+    a = _mm256_set_epi32 ( state[7][0], state[6][0], state[5][0], state[4][0],
+        state[3][0], state[2][0], state[1][0], state[0][0] );
+    b = _mm256_set_epi32 ( state[7][1], state[6][1], state[5][1], state[4][1],
+        state[3][1], state[2][1], state[1][1], state[0][1] );
+    c = _mm256_set_epi32 ( state[7][2], state[6][2], state[5][2], state[4][2],
+        state[3][2], state[2][2], state[1][2], state[0][2] );
+    d = _mm256_set_epi32 ( state[7][3], state[6][3], state[5][3], state[4][3],
+        state[3][3], state[2][3], state[1][3], state[0][3] );
+
+    for ( ; nblocks; nblocks-- )
+    {
+        /* transpose 8x8 word groups so that x[k] holds word k of every lane */
+        for ( g = 0; g < 2; g++ )
+        {
+            r[0] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[0] + 32 * g ) );
+            r[1] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[1] + 32 * g ) );
+            r[2] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[2] + 32 * g ) );
+            r[3] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[3] + 32 * g ) );
+            r[4] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[4] + 32 * g ) );
+            r[5] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[5] + 32 * g ) );
+            r[6] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[6] + 32 * g ) );
+            r[7] = _mm256_loadu_si256 ( ( const __m256i * ) ( data[7] + 32 * g ) );
+            t[0] = _mm256_unpacklo_epi32 ( r[0], r[1] );
+            t[1] = _mm256_unpackhi_epi32 ( r[0], r[1] );
+            t[2] = _mm256_unpacklo_epi32 ( r[2], r[3] );
+            t[3] = _mm256_unpackhi_epi32 ( r[2], r[3] );
+            t[4] = _mm256_unpacklo_epi32 ( r[4], r[5] );
+            t[5] = _mm256_unpackhi_epi32 ( r[4], r[5] );
+            t[6] = _mm256_unpacklo_epi32 ( r[6], r[7] );
+            t[7] = _mm256_unpackhi_epi32 ( r[6], r[7] );
+            u[0] = _mm256_unpacklo_epi64 ( t[0], t[2] );
+            u[1] = _mm256_unpackhi_epi64 ( t[0], t[2] );
+            u[2] = _mm256_unpacklo_epi64 ( t[1], t[3] );
+            u[3] = _mm256_unpackhi_epi64 ( t[1], t[3] );
+            u[4] = _mm256_unpacklo_epi64 ( t[4], t[6] );
+            u[5] = _mm256_unpackhi_epi64 ( t[4], t[6] );
+            u[6] = _mm256_unpacklo_epi64 ( t[5], t[7] );
+            u[7] = _mm256_unpackhi_epi64 ( t[5], t[7] );
+            x[8 * g + 0] = _mm256_permute2x128_si256 ( u[0], u[4], 0x20 );
+            x[8 * g + 1] = _mm256_permute2x128_si256 ( u[1], u[5], 0x20 );
+            x[8 * g + 2] = _mm256_permute2x128_si256 ( u[2], u[6], 0x20 );
+            x[8 * g + 3] = _mm256_permute2x128_si256 ( u[3], u[7], 0x20 );
+            x[8 * g + 4] = _mm256_permute2x128_si256 ( u[0], u[4], 0x31 );
+            x[8 * g + 5] = _mm256_permute2x128_si256 ( u[1], u[5], 0x31 );
+            x[8 * g + 6] = _mm256_permute2x128_si256 ( u[2], u[6], 0x31 );
+            x[8 * g + 7] = _mm256_permute2x128_si256 ( u[3], u[7], 0x31 );
+        }
+
+        aa = a;
+        bb = b;
+        cc = c;
+        dd = d;
+
+        MB_ROUNDS;
+
+        a = _mm256_add_epi32 ( a, aa );
+        b = _mm256_add_epi32 ( b, bb );
+        c = _mm256_add_epi32 ( c, cc );
+        d = _mm256_add_epi32 ( d, dd );
+
+        for ( g = 0; g < 8; g++ )
+        {
+            data[g] += 64;
+        }
+    }
+
+    _mm256_store_si256 ( ( __m256i * ) out[0], a );
+    _mm256_store_si256 ( ( __m256i * ) out[1], b );
+    _mm256_store_si256 ( ( __m256i * ) out[2], c );
+    _mm256_store_si256 ( ( __m256i * ) out[3], d );
+
+    for ( g = 0; g < 8; g++ )
+    {
+        state[g][0] = out[0][g];
+        state[g][1] = out[1][g];
+        state[g][2] = out[2][g];
+        state[g][3] = out[3][g];
+    }
+}
+
+#endif
+
+static MD5_MULTI_ENGINE md5_mb_engine;
+static pthread_once_t md5_mb_once = PTHREAD_ONCE_INIT;
+
+/* The routine MD5_Multi_Engines lists the lane kernels supported by this
+   cpu, widest first, MD5_MULTI_ENGINES at most. Returns their count.
+ */
+unsigned int MD5_Multi_Engines ( MD5_MULTI_ENGINE engines[] )
+{
+    unsigned int count = 0;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init (  );
+
+    if ( __builtin_cpu_supports ( "avx2" ) )
+    {
+        engines[count].fn = md5_mb_x8;
+        engines[count].lanes = 8;
+        engines[count++].name = "x8-avx2";
+    }
+
+    engines[count].fn = md5_mb_x4;
+    engines[count].lanes = 4;
+    engines[count++].name = "x4-sse2";
+#else
+    ( void ) engines;
+#endif
+
+    return count;
+}
+
+/* Pick the widest lane kernel supported by this cpu */
+static void md5_mb_setup ( void )
+{
+    MD5_MULTI_ENGINE engines[MD5_MULTI_ENGINES];
+
+    if ( MD5_Multi_Engines ( engines ) )
+    {
+        md5_mb_engine = engines[0];
+    } else
+    {
+        md5_mb_engine.fn = NULL;
+        md5_mb_engine.lanes = 1;
+        md5_mb_engine.name = "scalar";
+    }
+}
+
+/* Set lane kernel up once, callers on other threads wait until it is done */
+static void md5_mb_init ( void )
+{
+    pthread_once ( &md5_mb_once, md5_mb_setup );
+}
+
+/* The routine MD5_Multi_Engine names the lane kernel in use.
+ */
+const char *MD5_Multi_Engine ( void )
+{
+    md5_mb_init (  );
+    return md5_mb_engine.name;
+}
+
+/* Update count contexts at once with lane kernel of lanes lanes, see MD5_Update_Multi */
+static void md5_mb_update ( MD5_MULTI_KERNEL kernel, unsigned int lanes, MD5_CTX * mdContext[],
+    const void *inBuf[], const size_t inLen[], unsigned int count )
+{
+    unsigned int i;
+    unsigned int n;
+    unsigned int next = 0;
+    unsigned int used;
+    size_t head;
+    size_t step;
+    UINT4 spare[4];
+    UINT4 *state[MB_MAX_LANES];
+    const unsigned char *data[MB_MAX_LANES];
+    struct md5_mb_msg *slot[MB_MAX_LANES];
+    struct md5_mb_msg msgs[64];
+
+    /* work in batches the message table can hold */
+    if ( count > sizeof ( msgs ) / sizeof ( msgs[0] ) )
+    {
+        md5_mb_update ( kernel, lanes, mdContext + 64, inBuf + 64, inLen + 64, count - 64 );
+        count = 64;
+    }
+
+    /* bring every context to a block boundary, keep whole blocks aside */
+    for ( i = 0; i < count; i++ )
+    {
+        head = ( 64 - ( ( mdContext[i]->i[0] >> 3 ) & 0x3F ) ) & 0x3F;
+        if ( head > inLen[i] )
+        {
+            head = inLen[i];
+        }
+        MD5_Update ( mdContext[i], inBuf[i], head );
+        msgs[i].ctx = mdContext[i];
+        msgs[i].data = ( const unsigned char * ) inBuf[i] + head;
+        msgs[i].blocks = ( inLen[i] - head ) >> 6;
+    }
+
+    memset ( slot, 0, sizeof ( slot ) );
+
+    while ( kernel )
+    {
+        /* refill idle lanes */
+        for ( n = 0, used = 0; n < lanes; n++ )
+        {
+            while ( !slot[n] && next < count )
+            {
+                if ( msgs[next].blocks )
+                {
+                    slot[n] = &msgs[next];
+                }
+                next++;
+            }
+            used += slot[n] != NULL;
+        }
+
+        /* a lone message is faster on the scalar engine */
+        if ( used < 2 )
+        {
+            break;
+        }
+
+        /* run until the shortest message runs dry */
+        step = ( size_t ) -1;
+        for ( n = 0; n < lanes; n++ )
+        {
+            if ( slot[n] && slot[n]->blocks < step )
+            {
+                step = slot[n]->blocks;
+            }
+        }
+
+        /* idle lanes replay a busy lane into a spare state */
+        for ( n = 0; n < lanes; n++ )
+        {
+            for ( i = n; !slot[i]; i = ( i + 1 ) % lanes );
+            state[n] = slot[n] ? slot[n]->ctx->buf : spare;
+            data[n] = slot[i]->data;
+        }
+
+        kernel ( state, data, step );
+
+        for ( n = 0; n < lanes; n++ )
+        {
+            if ( slot[n] )
+            {
+                slot[n]->ctx->i[1] += ( UINT4 ) ( ( unsigned long long ) step >> 23 );
+                if ( ( UINT4 ) ( slot[n]->ctx->i[0] + ( ( UINT4 ) step << 9 ) ) <
+                    slot[n]->ctx->i[0] )
+                {
+                    slot[n]->ctx->i[1]++;
+                }
+                slot[n]->ctx->i[0] += ( UINT4 ) step << 9;
+                slot[n]->data += step << 6;
+                slot[n]->blocks -= step;
+                if ( !slot[n]->blocks )
+                {
+                    slot[n] = NULL;
+                }
+            }
+        }
+    }
+
+    /* leftover whole blocks, then every tail */
+    for ( i = 0; i < count; i++ )
+    {
+        head = ( const unsigned char * ) msgs[i].data - ( const unsigned char * ) inBuf[i];
+        MD5_Update ( mdContext[i], msgs[i].data, inLen[i] - head );
+    }
+}
+
+/* The routine MD5_Update_Multi is MD5_Update applied to count independent
+   contexts at once, inBuf[n] and inLen[n] going into mdContext[n].
+ */
+void MD5_Update_Multi ( MD5_CTX * mdContext[], const void *inBuf[], const size_t inLen[],
+    unsigned int count )
+{
+    md5_mb_init (  );
+    md5_mb_update ( md5_mb_engine.fn, md5_mb_engine.lanes, mdContext, inBuf, inLen, count );
+}
+
+/* The routine MD5_Update_Multi_Engine is MD5_Update_Multi hashing with
+   the lane kernel of engine instead of the selected one.
+ */
+void MD5_Update_Multi_Engine ( const MD5_MULTI_ENGINE * engine, MD5_CTX * mdContext[],
+    const void *inBuf[], const size_t inLen[], unsigned int count )
+{
+    md5_mb_update ( engine->fn, engine->lanes, mdContext, inBuf, inLen, count );
+}
@@ -0,0 +1,279 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Verification Cache
+ * ------------------------------------------------------------------ */
+
+#include <sys/time.h>
+
+#include "fwtest.h"
+
+#define FW_CACHE_TEST_SIZE 8192
+#define FW_CACHE_TEST_OUTPUT 4096
+#define FW_CACHE_TEST_HEAD 64   /* cache file header, slot size at offset 12 */
+#define FW_CACHE_TEST_SLOTS 16384
+
+/* Start of a cache slot as fwcache.c lays it out */
+struct fw_cache_test_slot
+{
+    struct fw_cache_key key;
+    uint32_t used;
+    int32_t result;
+    uint64_t size;
+    char format[8];
+    uint32_t count;
+    uint32_t reserved;
+    char name[FW_NAME_MAX];     /* first checksum */
+    uint32_t len;
+};
+
+/* Ways a slot gets damaged */
+static const char *fw_cache_damage[] = {
+    "count",
+    "result",
+    "length",
+    "format",
+    "name"
+};
+
+/* Damage slot in the way given by fw_cache_damage index */
+static void fw_cache_test_damage ( struct fw_cache_test_slot *slot, unsigned int how )
+{
+    switch ( how )
+    {
+    case 0:
+        slot->count = 4000;
+        slot->result = 1000;
+        break;
+    case 1:
+        slot->result = -1;
+        break;
+    case 2:
+        slot->len = 1000;
+        break;
+    case 3:
+        memset ( slot->format, 'x', sizeof ( slot->format ) );
+        break;
+    default:
+        memset ( slot->name, 'x', sizeof ( slot->name ) );
+        break;
+    }
+}
+
+/* Find the one used slot of cache, its offset goes to off */
+static int fw_cache_test_find ( int fd, off_t * off, struct fw_cache_test_slot *slot )
+{
+    unsigned int i;
+    uint32_t slot_size;
+
+    if ( pread ( fd, &slot_size, sizeof ( slot_size ), 12 ) != sizeof ( slot_size ) )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < FW_CACHE_TEST_SLOTS; i++ )
+    {
+        *off = FW_CACHE_TEST_HEAD + ( off_t ) i * slot_size;
+        if ( pread ( fd, slot, sizeof ( *slot ), *off ) != sizeof ( *slot ) )
+        {
+            return -1;
+        }
+        if ( slot->used )
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/* Run fwcheck with cache on image, compare with expect unless NULL */
+static int fw_cache_test_run ( const char *tools, const char *cache, const char *path,
+    char *out, const char *expect, int *status )
+{
+    int ret;
+    char args[4160];
+
+    snprintf ( args, sizeof ( args ), "--format json --cache '%s'", cache );
+    if ( fw_test_tool ( tools, "fwcheck", args, path, out, FW_CACHE_TEST_OUTPUT, &ret ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( expect && ( strcmp ( out, expect ) || ret != *status ) )
+    {
+        fprintf ( stderr, "fwcheck %s: exit status %d, output differs:\n%s", args, ret, out );
+        return -1;
+    }
+
+    *status = ret;
+    return 0;
+}
+
+/* Fill cache with image, damage its slot, fwcheck must verify again and store anew */
+static int fw_cache_test_check ( const char *tools, const char *cache, const char *path,
+    unsigned int how )
+{
+    int fd;
+    int status;
+    off_t off;
+    struct fw_cache_test_slot slot;
+    char expect[FW_CACHE_TEST_OUTPUT];
+    char out[FW_CACHE_TEST_OUTPUT];
+
+    unlink ( cache );
+    if ( fw_cache_test_run ( tools, cache, path, expect, NULL, &status ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( ( fd = open ( cache, O_RDWR ) ) < 0 )
+    {
+        perror ( cache );
+        return -1;
+    }
+
+    if ( fw_cache_test_find ( fd, &off, &slot ) < 0 )
+    {
+        fprintf ( stderr, "%s: result was not stored\n", cache );
+        close ( fd );
+        return -1;
+    }
+
+    fw_cache_test_damage ( &slot, how );
+    if ( pwrite ( fd, &slot, sizeof ( slot ), off ) != sizeof ( slot ) )
+    {
+        perror ( cache );
+        close ( fd );
+        return -1;
+    }
+
+    if ( fw_cache_test_run ( tools, cache, path, out, expect, &status ) < 0
+        || pread ( fd, &slot, sizeof ( slot ), off ) != sizeof ( slot )
+        || !slot.used || slot.count > FW_CHECKS_MAX )
+    {
+        close ( fd );
+        return -1;
+    }
+
+    close ( fd );
+    return 0;
+}
+
+/* Set file times to t seconds, results of files written just now are not cached */
+static int fw_cache_test_time ( const char *path, long t )
+{
+    struct timeval times[2];
+
+    memset ( times, '\0', sizeof ( times ) );
+    times[0].tv_sec = times[1].tv_sec = t;
+    return utimes ( path, times );
+}
+
+/* Flip last byte of file, its mtime is set to t seconds */
+static int fw_cache_test_flip ( const char *path, long t )
+{
+    int fd;
+    unsigned char byte;
+
+    if ( ( fd = open ( path, O_RDWR ) ) < 0 )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    if ( pread ( fd, &byte, 1, FW_CACHE_TEST_SIZE - 1 ) != 1 )
+    {
+        close ( fd );
+        return -1;
+    }
+    byte ^= 0xff;
+    if ( pwrite ( fd, &byte, 1, FW_CACHE_TEST_SIZE - 1 ) != 1 )
+    {
+        close ( fd );
+        return -1;
+    }
+
+    close ( fd );
+    return fw_cache_test_time ( path, t );
+}
+
+/* Cached result must come back while size and mtime stay, not once mtime moved */
+static int fw_cache_test_reuse ( const char *tools, const char *cache, const char *path )
+{
+    int status;
+    char out[FW_CACHE_TEST_OUTPUT];
+    char expect[FW_CACHE_TEST_OUTPUT];
+
+    /* stamped correct and cached */
+    unlink ( cache );
+    if ( fw_test_tool ( tools, "trxcrc32", "-u", path, out, sizeof ( out ), &status ) < 0
+        || status || fw_cache_test_time ( path, 1000000000 ) < 0
+        || fw_cache_test_run ( tools, cache, path, expect, NULL, &status ) < 0
+        || !strstr ( expect, "\"status\":\"correct\"" ) )
+    {
+        return -1;
+    }
+
+    /* a hit is told apart by the stale result of a write that kept the mtime */
+    if ( fw_cache_test_flip ( path, 1000000000 ) < 0
+        || fw_cache_test_run ( tools, cache, path, out, expect, &status ) < 0 )
+    {
+        return -1;
+    }
+
+    /* undone and written again, this time moving the mtime, it is verified again */
+    if ( fw_cache_test_flip ( path, 1000000000 ) < 0
+        || fw_cache_test_flip ( path, 1000000001 ) < 0
+        || fw_cache_test_run ( tools, cache, path, out, NULL, &status ) < 0
+        || !strstr ( out, "\"status\":\"incorrect\"" ) )
+    {
+        fprintf ( stderr, "fwcheck: rewritten file was answered from cache:\n%s", out );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Check fwcheck against damaged and reused cache slots, 0 if all passed */
+int fw_test_cache ( const char *tools, const char *tmpdir )
+{
+    int status = 0;
+    unsigned int i;
+    unsigned char *buf;
+    char path[4096];
+    char cache[4096];
+    FILE *file;
+
+    if ( !( buf = ( unsigned char * ) malloc ( FW_CACHE_TEST_SIZE ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    snprintf ( path, sizeof ( path ), "%s/cache.bin", tmpdir );
+    snprintf ( cache, sizeof ( cache ), "%s/cache.db", tmpdir );
+
+    fw_fill ( buf, FW_CACHE_TEST_SIZE, FW_TEST_SEED );
+    if ( fw_skeleton ( "trx", buf, FW_CACHE_TEST_SIZE ) < 0
+        || !( file = fopen ( path, "wb" ) ) )
+    {
+        free ( buf );
+        return fw_test_report ( "cache", "image", -1 );
+    }
+    fwrite ( buf, 1, FW_CACHE_TEST_SIZE, file );
+    fclose ( file );
+    free ( buf );
+
+    fw_cache_test_time ( path, 1000000000 );
+
+    for ( i = 0; i < sizeof ( fw_cache_damage ) / sizeof ( fw_cache_damage[0] ); i++ )
+    {
+        status |= fw_test_report ( "cache", fw_cache_damage[i],
+            fw_cache_test_check ( tools, cache, path, i ) );
+    }
+
+    status |= fw_test_report ( "cache", "reuse", fw_cache_test_reuse ( tools, cache, path ) );
+
+    unlink ( cache );
+    unlink ( path );
+    return status;
+}
@@ -0,0 +1,257 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Crc32 Engines
+ * ------------------------------------------------------------------ */
+
+#include "fwtest.h"
+
+#define CRC32_TEST_LEN 4096
+#define CRC32_TEST_BLOCK (1 << 20)
+
+/* Standard check values, preset and final xor included */
+static const struct
+{
+    const char *msg;
+    uint32_t crc;
+} crc32_kat[] = {
+    {"", 0x00000000},
+    {"a", 0xe8b7be43},
+    {"abc", 0x352441c2},
+    {"message digest", 0x20159d7f},
+    {"123456789", 0xcbf43926},
+    {"The quick brown fox jumps over the lazy dog", 0x414fa339}
+};
+
+/* Bit at a time register update, shares no table with the engines */
+static uint32_t crc32_test_ref ( uint32_t crc, const uint8_t * buf, size_t len )
+{
+    unsigned int k;
+
+    for ( ; len; --len, ++buf )
+    {
+        crc ^= *buf;
+        for ( k = 0; k < 8; k++ )
+        {
+            crc = ( crc & 1 ) ? ( crc >> 1 ) ^ 0xedb88320 : crc >> 1;
+        }
+    }
+
+    return crc;
+}
+
+/* Check one engine against check values and the bit loop */
+static int crc32_test_engine ( crc32_update_t fn, const uint8_t * buf )
+{
+    unsigned int i;
+    size_t align;
+    size_t len;
+    size_t split;
+    uint32_t crc;
+
+    for ( i = 0; i < sizeof ( crc32_kat ) / sizeof ( crc32_kat[0] ); i++ )
+    {
+        if ( ( fn ( 0xFFFFFFFF, ( const uint8_t * ) crc32_kat[i].msg,
+                    strlen ( crc32_kat[i].msg ) ) ^ 0xFFFFFFFF ) != crc32_kat[i].crc )
+        {
+            return -1;
+        }
+    }
+
+    /* every length at every alignment, in one and in two updates */
+    for ( align = 0; align < 16; align++ )
+    {
+        for ( crc = 0xFFFFFFFF, len = 0; len <= CRC32_TEST_LEN; len++ )
+        {
+            if ( len )
+            {
+                crc = crc32_test_ref ( crc, buf + align + len - 1, 1 );
+            }
+            split = len / 3;
+
+            if ( fn ( 0xFFFFFFFF, buf + align, len ) != crc
+                || fn ( fn ( 0xFFFFFFFF, buf + align, split ), buf + align + split,
+                    len - split ) != crc )
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Check combine and threads against one-shot checksums */
+static int crc32_test_combine ( uint8_t * buf, size_t len )
+{
+    unsigned int threads;
+    size_t split;
+    uint32_t crc = crc32buf ( buf, len );
+
+    for ( split = 0; split <= len; split += split < 256 ? 1 : 4093 )
+    {
+        if ( crc32_combine ( crc32buf ( buf, split ), crc32buf ( buf + split, len - split ),
+                len - split ) != crc )
+        {
+            return -1;
+        }
+    }
+
+    for ( threads = 2; threads <= 8; threads++ )
+    {
+        if ( crc32buf_mt ( buf, len, threads ) != crc )
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Check patched checksums against the patched buffer hashed again */
+static int crc32_test_patch ( uint8_t * buf, size_t len )
+{
+    size_t off;
+    size_t n;
+    size_t i;
+    uint32_t crc = crc32buf ( buf, len );
+    uint8_t old[300];
+
+    for ( off = 0; off < len; off += off < 16 ? 1 : 65521 )
+    {
+        for ( n = 1; n <= sizeof ( old ) && off + n <= len; n += n < 8 ? 1 : 97 )
+        {
+            memcpy ( old, buf + off, n );
+            for ( i = 0; i < n; i++ )
+            {
+                buf[off + i] = ~buf[off + i] ^ ( uint8_t ) i;
+            }
+
+            if ( crc32_patch ( crc, old, buf + off, n, len - off - n ) != crc32buf ( buf, len ) )
+            {
+                memcpy ( buf + off, old, n );
+                return -1;
+            }
+
+            memcpy ( buf + off, old, n );
+        }
+    }
+
+    return 0;
+}
+
+/* Check fast-forwarded runs against the same runs hashed by engine fn */
+static int crc32_test_fill ( crc32_update_t fn, const uint8_t * buf, size_t len )
+{
+    static const uint8_t bytes[] = { 0x00, 0xFF, 0x5A };
+    unsigned int i;
+    size_t n;
+    size_t off;
+    uint32_t crc;
+    uint8_t *copy;
+
+    if ( !( copy = ( uint8_t * ) malloc ( len ) ) )
+    {
+        return -1;
+    }
+
+    for ( i = 0; i < sizeof ( bytes ); i++ )
+    {
+        memset ( copy, bytes[i], len );
+        crc = crc32_test_ref ( 0xFFFFFFFF, buf, 64 );
+
+        for ( n = 0; n <= len; n += n < 64 ? 1 : 4099 )
+        {
+            if ( crc32_fill ( crc, bytes[i], n ) != fn ( crc, copy, n ) )
+            {
+                free ( copy );
+                return -1;
+            }
+        }
+    }
+
+    /* runs of every size at odd offsets, noise around them */
+    memcpy ( copy, buf, len );
+    for ( off = 1, n = 1, i = 0; off + n < len; off += 2 * n + 4097, n = n * 3 + 1111, i++ )
+    {
+        memset ( copy + off, bytes[i % sizeof ( bytes )], n );
+    }
+    memset ( copy + len - 65537, 0xFF, 65537 );
+
+    for ( off = 0; off < len; off += 65537 )
+    {
+        if ( crc32_update ( 0xFFFFFFFF, copy + off, len - off )
+            != fn ( 0xFFFFFFFF, copy + off, len - off ) )
+        {
+            free ( copy );
+            return -1;
+        }
+    }
+
+    free ( copy );
+    return 0;
+}
+
+/* Check a stream past 4 GiB against block checksums combined */
+static int crc32_test_large ( const uint8_t * block )
+{
+    unsigned int i;
+    unsigned int count = ( unsigned int ) ( ( ( uint64_t ) 4 << 30 ) / CRC32_TEST_BLOCK );
+    uint32_t crc = 0xFFFFFFFF;
+    uint32_t one = crc32_update ( 0xFFFFFFFF, block, CRC32_TEST_BLOCK );
+    uint32_t rest = one;
+
+    for ( i = 0; i <= count; i++ )
+    {
+        crc = crc32_update ( crc, block, CRC32_TEST_BLOCK );
+    }
+
+    for ( i = 1; i < count; i++ )
+    {
+        rest = crc32_combine ( rest, one, CRC32_TEST_BLOCK );
+    }
+
+    /* the last combine shifts across all 4 GiB at once */
+    return crc32_combine ( one, rest, ( size_t ) count * CRC32_TEST_BLOCK ) == crc ? 0 : -1;
+}
+
+/* Check every crc32 engine, 0 if all passed */
+int fw_test_crc32 ( void )
+{
+    int status = 0;
+    unsigned int i;
+    unsigned int count;
+    uint8_t *buf;
+    struct crc32_engine_desc engines[CRC32_ENGINES];
+
+    if ( !( buf = ( uint8_t * ) malloc ( CRC32_TEST_BLOCK ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    fw_fill ( buf, CRC32_TEST_BLOCK, FW_TEST_SEED );
+    count = crc32_engines ( engines );
+
+    for ( i = 0; i < count; i++ )
+    {
+        status |= fw_test_report ( "crc32", engines[i].name,
+            crc32_test_engine ( engines[i].fn, buf ) );
+    }
+
+    status |= fw_test_report ( "crc32", "combine",
+        crc32_test_combine ( buf, CRC32_TEST_BLOCK - 123 ) );
+    status |= fw_test_report ( "crc32", "patch",
+        crc32_test_patch ( buf, CRC32_TEST_BLOCK - 123 ) );
+
+    /* the table engine comes last and was checked above */
+    status |= fw_test_report ( "crc32", "fill",
+        crc32_test_fill ( engines[count - 1].fn, buf, CRC32_TEST_BLOCK ) );
+
+    /* lengths past 32 bits need a 64-bit size_t */
+    if ( sizeof ( size_t ) > 4 )
+    {
+        status |= fw_test_report ( "crc32", "4 GiB stream", crc32_test_large ( buf ) );
+    }
+
+    free ( buf );
+    return status;
+}
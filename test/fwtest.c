@@ -0,0 +1,92 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Main Program File
+ * ------------------------------------------------------------------ */
+
+#include <sys/wait.h>
+
+#include "fwtest.h"
+
+/* Show program usage */
+static void show_usage ( void )
+{
+    fprintf ( stderr, "usage: fwtest tools fixtures\n\n"
+        "  tools       directory holding trxcrc32, bcmcrc32, tlmd5 and fwcheck\n"
+        "  fixtures    directory holding expected tool output\n\n" );
+}
+
+/* Print one test result, returns status */
+int fw_test_report ( const char *group, const char *name, int status )
+{
+    printf ( "%-6s %-16s : %s\n", group, name, status < 0 ? "FAILED" : "ok" );
+    fflush ( stdout );
+    return status;
+}
+
+/* Run tool on file, output and exit status go to out and status */
+int fw_test_tool ( const char *tools, const char *tool, const char *args, const char *path,
+    char *out, size_t size, int *status )
+{
+    int ret;
+    size_t len = 0;
+    size_t n;
+    FILE *pipe;
+    char cmd[8192];
+
+    snprintf ( cmd, sizeof ( cmd ), "'%s/%s' %s '%s' 2>&1", tools, tool, args, path );
+
+    if ( !( pipe = popen ( cmd, "r" ) ) )
+    {
+        perror ( "popen" );
+        return -1;
+    }
+
+    while ( len + 1 < size && ( n = fread ( out + len, 1, size - len - 1, pipe ) ) > 0 )
+    {
+        len += n;
+    }
+    out[len] = '\0';
+
+    if ( ( ret = pclose ( pipe ) ) < 0 || !WIFEXITED ( ret ) )
+    {
+        fprintf ( stderr, "Error: %s did not exit\n", tool );
+        return -1;
+    }
+
+    *status = WEXITSTATUS ( ret );
+    return 0;
+}
+
+/* Test suite main function */
+int main ( int argc, char *argv[] )
+{
+    int status = 0;
+    const char *tmpdir;
+    char dir[4096];
+
+    if ( argc != 3 )
+    {
+        show_usage (  );
+        return 1;
+    }
+
+    if ( !( tmpdir = getenv ( "TMPDIR" ) ) )
+    {
+        tmpdir = "/tmp";
+    }
+
+    snprintf ( dir, sizeof ( dir ), "%s/fwtest-XXXXXX", tmpdir );
+    if ( !mkdtemp ( dir ) )
+    {
+        perror ( dir );
+        return 1;
+    }
+
+    status |= fw_test_crc32 (  );
+    status |= fw_test_md5 (  );
+    status |= fw_test_golden ( argv[1], argv[2], dir );
+    status |= fw_test_cache ( argv[1], dir );
+    status |= fw_test_index ( argv[1], dir );
+
+    rmdir ( dir );
+    return status < 0 ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Shared Test Header
+ * ------------------------------------------------------------------ */
+
+#include "fwsynth.h"
+#include "md5.h"
+
+#ifndef FWTEST_H
+#define FWTEST_H
+
+#define FW_TEST_SEED 0x9e3779b97f4a7c15ULL
+
+/* Print one test result, returns status */
+extern int fw_test_report ( const char *group, const char *name, int status );
+
+/* Run tool on file, output and exit status go to out and status */
+extern int fw_test_tool ( const char *tools, const char *tool, const char *args,
+    const char *path, char *out, size_t size, int *status );
+
+/* Check every crc32 engine, 0 if all passed */
+extern int fw_test_crc32 ( void );
+
+/* Check every md5 block function and lane kernel, 0 if all passed */
+extern int fw_test_md5 ( void );
+
+/* Check tool output of golden images against fixtures, 0 if all passed */
+extern int fw_test_golden ( const char *tools, const char *fixtures, const char *tmpdir );
+
+/* Check fwcheck against damaged and reused cache slots, 0 if all passed */
+extern int fw_test_cache ( const char *tools, const char *tmpdir );
+
+/* Check block index against unchanged and changed images, 0 if all passed */
+extern int fw_test_index ( const char *tools, const char *tmpdir );
+
+#endif
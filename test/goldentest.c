@@ -0,0 +1,390 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Golden Images
+ * ------------------------------------------------------------------ */
+
+#include <arpa/inet.h>
+
+#include "fwtest.h"
+#include "trxcrc32.h"
+#include "bcmcrc32.h"
+#include "tlmd5.h"
+
+#define FW_GOLDEN_SIZE 8192
+#define FW_GOLDEN_OUTPUT 65536
+#define FW_GOLDEN_NOISE 65536
+#define FW_GOLDEN_FAKES 5
+#define FW_GOLDEN_PATCH "--patch 4222:deadbeef"
+
+/*
+ * Golden images are synthetic images whose checksums were computed
+ * with an independent implementation (zlib, hashlib). They are stored
+ * into the header, the tool must report them correct and print what
+ * the fixture <name>.out holds, fwcheck what <name>-fwcheck.out holds,
+ * and the tool <name>-bad.out once a payload byte is flipped. The tools
+ * exit 0 either way, only the output tells a bad checksum apart. The
+ * payload is the fw_fill noise seeded with the size.
+ *
+ * Tools with --patch write FW_GOLDEN_PATCH across the bcm rootfs/kernel
+ * border, printing <name>-patch.out, after which the plain tool must
+ * print <name>-patched.out, whose checksums were computed the same
+ * independent way. The reject patch, over header bytes no checksum
+ * covers (trx: before flags_off), must exit 1 and leave the image alone.
+ */
+static const struct fw_golden
+{
+    const char *name;
+    const char *tool;
+    const char *reject;
+    unsigned int count;
+    unsigned char sums[FW_CHECKS_MAX][FW_SUM_MAX];
+} fw_goldens[] = {
+    {"trx", "trxcrc32", "--patch 4:00", 1, {{0xfd, 0x07, 0xbe, 0x25}}},
+    {"bcm", "bcmcrc32", "--patch 216:00", 4, {{0xb8, 0x37, 0x91, 0xf8},
+            {0xd8, 0xc6, 0x22, 0x6a}, {0x59, 0x33, 0xea, 0x74}, {0xa2, 0xe0, 0xb9, 0x63}}},
+    {"tplink", "tlmd5", NULL, 1, {{0x2b, 0x3d, 0xf4, 0x4d, 0xa1, 0x62, 0x72, 0xc5,
+                0xd8, 0x9e, 0x09, 0x04, 0x1c, 0x15, 0x3b, 0xc1}}}
+};
+
+/* Load big-endian 32-bit word */
+static uint32_t fw_golden_be32 ( const unsigned char *p )
+{
+    return ( ( uint32_t ) p[0] << 24 ) | ( ( uint32_t ) p[1] << 16 )
+        | ( ( uint32_t ) p[2] << 8 ) | p[3];
+}
+
+/* Store golden checksums into header as the format keeps them */
+static void fw_golden_store ( const struct fw_golden *golden, unsigned char *buf )
+{
+    struct trx_header *trx = ( struct trx_header * ) buf;
+    struct bcm_header_v1 *bcm = ( struct bcm_header_v1 * ) buf;
+    struct fw_header_v1 *tplink = ( struct fw_header_v1 * ) buf;
+
+    if ( !strcmp ( golden->name, "trx" ) )
+    {
+        trx->crc32 = fw_golden_be32 ( golden->sums[0] );
+
+    } else if ( !strcmp ( golden->name, "bcm" ) )
+    {
+        bcm->data_crc32 = htonl ( fw_golden_be32 ( golden->sums[0] ) );
+        bcm->rootfs_crc32 = htonl ( fw_golden_be32 ( golden->sums[1] ) );
+        bcm->kernel_crc32 = htonl ( fw_golden_be32 ( golden->sums[2] ) );
+        bcm->header_crc32 = htonl ( fw_golden_be32 ( golden->sums[3] ) );
+
+    } else
+    {
+        memcpy ( tplink->md5sum1, golden->sums[0], MD5SUM_LEN );
+    }
+}
+
+/* Build golden image into buf of FW_GOLDEN_SIZE bytes */
+static int fw_golden_build ( const struct fw_golden *golden, unsigned char *buf )
+{
+    fw_fill ( buf, FW_GOLDEN_SIZE, FW_GOLDEN_SIZE );
+    if ( fw_skeleton ( golden->name, buf, FW_GOLDEN_SIZE ) < 0 )
+    {
+        return -1;
+    }
+    fw_golden_store ( golden, buf );
+
+    return 0;
+}
+
+/* Plant TP-Link version word with a header that does not hold up, one of FW_GOLDEN_FAKES */
+static void fw_golden_fake ( unsigned char *buf, unsigned int how )
+{
+    struct fw_header_v1 *v1 = ( struct fw_header_v1 * ) buf;
+    struct fw_header_v2 *v2 = ( struct fw_header_v2 * ) buf;
+
+    memset ( buf, '\0', sizeof ( struct fw_header_v1 ) );
+    v1->version = htonl ( HEADER_VERSION_V1 );
+    strcpy ( v1->vendor_name, "TP-LINK Technologies" );
+    v1->fw_length = htonl ( 4096 );
+    v1->kernel_ofs = htonl ( sizeof ( struct fw_header_v1 ) );
+    v1->kernel_len = htonl ( 2048 );
+
+    switch ( how )
+    {
+    case 0:
+        /* short string followed by other data */
+        memcpy ( v1->vendor_name, ")\0\0\0P5~\3", 8 );
+        break;
+    case 1:
+        /* kernel within the header */
+        v1->kernel_ofs = 0;
+        break;
+    case 2:
+        /* rootfs over the kernel */
+        v1->rootfs_ofs = htonl ( 1024 );
+        v1->rootfs_len = htonl ( 1024 );
+        break;
+    case 3:
+        /* no vendor */
+        memset ( v1->vendor_name, '\0', sizeof ( v1->vendor_name ) );
+        break;
+    default:
+        /* version 2 has no vendor, its version string is empty */
+        memset ( buf, '\0', sizeof ( struct fw_header_v1 ) );
+        v2->version = HEADER_VERSION_V2;
+        v2->fw_length = htonl ( 4096 );
+        v2->kernel_ofs = htonl ( sizeof ( struct fw_header_v2 ) );
+        v2->kernel_len = htonl ( 2048 );
+        break;
+    }
+}
+
+/* Write whole buffer into file */
+static int fw_golden_write ( const char *path, const unsigned char *buf, size_t len )
+{
+    FILE *file;
+
+    if ( !( file = fopen ( path, "wb" ) ) )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    if ( fwrite ( buf, 1, len, file ) != len || fclose ( file ) )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Run tool on image, output must match fixture and exit status must be 0 */
+static int fw_golden_run ( const char *tools, const char *tool, const char *args,
+    const char *path, const char *fixture )
+{
+    int status;
+    size_t len;
+    FILE *file;
+    char *out;
+    char *expect;
+
+    if ( !( out = ( char * ) malloc ( 2 * FW_GOLDEN_OUTPUT ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+    expect = out + FW_GOLDEN_OUTPUT;
+
+    if ( !( file = fopen ( fixture, "rb" ) ) )
+    {
+        perror ( fixture );
+        free ( out );
+        return -1;
+    }
+    len = fread ( expect, 1, FW_GOLDEN_OUTPUT - 1, file );
+    expect[len] = '\0';
+    fclose ( file );
+
+    if ( fw_test_tool ( tools, tool, args, path, out, FW_GOLDEN_OUTPUT, &status ) < 0 )
+    {
+        free ( out );
+        return -1;
+    }
+
+    if ( strcmp ( out, expect ) || status )
+    {
+        fprintf ( stderr, "%s %s: exit status %d, output differs from %s:\n%s",
+            tool, args, status, fixture, out );
+        free ( out );
+        return -1;
+    }
+
+    free ( out );
+    return 0;
+}
+
+/* Build golden image, check tool output mapped, streamed, detected and corrupted */
+static int fw_golden_check ( const struct fw_golden *golden, const char *tools,
+    const char *fixtures, const char *tmpdir )
+{
+    int status = -1;
+    unsigned char *buf;
+    char path[4096];
+    char good[4096];
+    char detect[4096];
+    char bad[4096];
+
+    if ( !( buf = ( unsigned char * ) malloc ( FW_GOLDEN_SIZE ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( fw_golden_build ( golden, buf ) < 0 )
+    {
+        free ( buf );
+        return -1;
+    }
+
+    snprintf ( path, sizeof ( path ), "%s/%s.bin", tmpdir, golden->name );
+    snprintf ( good, sizeof ( good ), "%s/%s.out", fixtures, golden->name );
+    snprintf ( detect, sizeof ( detect ), "%s/%s-fwcheck.out", fixtures, golden->name );
+    snprintf ( bad, sizeof ( bad ), "%s/%s-bad.out", fixtures, golden->name );
+
+    if ( !fw_golden_write ( path, buf, FW_GOLDEN_SIZE )
+        && !fw_golden_run ( tools, golden->tool, "", path, good )
+        && !fw_golden_run ( tools, golden->tool, "-s", path, good )
+        && !fw_golden_run ( tools, "fwcheck", "", path, detect ) )
+    {
+        /* a flipped payload byte must not go unnoticed */
+        buf[FW_GOLDEN_SIZE - 1] ^= 0xff;
+        if ( !fw_golden_write ( path, buf, FW_GOLDEN_SIZE )
+            && !fw_golden_run ( tools, golden->tool, "", path, bad ) )
+        {
+            status = 0;
+        }
+    }
+
+    unlink ( path );
+    free ( buf );
+    return status;
+}
+
+/* Run refused patch on image, exit status must be 1 */
+static int fw_golden_reject ( const char *tools, const char *tool, const char *args,
+    const char *path )
+{
+    int status;
+    char out[FW_GOLDEN_OUTPUT];
+
+    if ( fw_test_tool ( tools, tool, args, path, out, sizeof ( out ), &status ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( status != 1 )
+    {
+        fprintf ( stderr, "%s %s: exit status %d, patch was not refused:\n%s",
+            tool, args, status, out );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Build golden image, patch it, check tool output and a refused patch */
+static int fw_golden_patch ( const struct fw_golden *golden, const char *tools,
+    const char *fixtures, const char *tmpdir )
+{
+    int status = -1;
+    unsigned char *buf;
+    char path[4096];
+    char good[4096];
+    char patch[4096];
+    char patched[4096];
+
+    if ( !( buf = ( unsigned char * ) malloc ( FW_GOLDEN_SIZE ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( fw_golden_build ( golden, buf ) < 0 )
+    {
+        free ( buf );
+        return -1;
+    }
+
+    snprintf ( path, sizeof ( path ), "%s/%s-patch.bin", tmpdir, golden->name );
+    snprintf ( good, sizeof ( good ), "%s/%s.out", fixtures, golden->name );
+    snprintf ( patch, sizeof ( patch ), "%s/%s-patch.out", fixtures, golden->name );
+    snprintf ( patched, sizeof ( patched ), "%s/%s-patched.out", fixtures, golden->name );
+
+    /* a refused patch leaves the image as it was */
+    if ( !fw_golden_write ( path, buf, FW_GOLDEN_SIZE )
+        && !fw_golden_reject ( tools, golden->tool, golden->reject, path )
+        && !fw_golden_run ( tools, golden->tool, "", path, good )
+        && !fw_golden_run ( tools, golden->tool, FW_GOLDEN_PATCH, path, patch )
+        && !fw_golden_run ( tools, golden->tool, "", path, patched ) )
+    {
+        status = 0;
+    }
+
+    unlink ( path );
+    free ( buf );
+    return status;
+}
+
+/* Scan golden images embedded in noise holding false TP-Link headers */
+static int fw_golden_scan ( const char *tools, const char *fixtures, const char *tmpdir )
+{
+    int status = -1;
+    unsigned int i;
+    unsigned int n;
+    size_t off;
+    size_t len = 0;
+    unsigned char *buf;
+    char path[4096];
+    char fixture[4096];
+
+    n = sizeof ( fw_goldens ) / sizeof ( fw_goldens[0] );
+    if ( !( buf = ( unsigned char * ) malloc ( n * ( FW_GOLDEN_NOISE + FW_GOLDEN_SIZE )
+                + FW_GOLDEN_NOISE ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    /* noise, image, noise, ..., noise; fakes every 4 KiB of noise */
+    for ( i = 0; i <= n; i++ )
+    {
+        fw_fill ( buf + len, FW_GOLDEN_NOISE, FW_TEST_SEED + i );
+        for ( off = 0; off < FW_GOLDEN_NOISE; off += 4096 )
+        {
+            fw_golden_fake ( buf + len + off, off / 4096 % FW_GOLDEN_FAKES );
+        }
+        len += FW_GOLDEN_NOISE;
+
+        if ( i < n && fw_golden_build ( &fw_goldens[i], buf + len ) < 0 )
+        {
+            free ( buf );
+            return -1;
+        }
+        len += i < n ? FW_GOLDEN_SIZE : 0;
+    }
+
+    snprintf ( path, sizeof ( path ), "%s/scan.bin", tmpdir );
+    snprintf ( fixture, sizeof ( fixture ), "%s/scan.out", fixtures );
+
+    if ( !fw_golden_write ( path, buf, len )
+        && !fw_golden_run ( tools, "fwcheck", "-f", path, fixture ) )
+    {
+        status = 0;
+    }
+
+    unlink ( path );
+    free ( buf );
+    return status;
+}
+
+/* Check tool output of golden images against fixtures, 0 if all passed */
+int fw_test_golden ( const char *tools, const char *fixtures, const char *tmpdir )
+{
+    int status = 0;
+    unsigned int i;
+    char name[32];
+
+    for ( i = 0; i < sizeof ( fw_goldens ) / sizeof ( fw_goldens[0] ); i++ )
+    {
+        status |= fw_test_report ( "image", fw_goldens[i].name,
+            fw_golden_check ( &fw_goldens[i], tools, fixtures, tmpdir ) );
+    }
+
+    for ( i = 0; i < sizeof ( fw_goldens ) / sizeof ( fw_goldens[0] ); i++ )
+    {
+        if ( fw_goldens[i].reject )
+        {
+            snprintf ( name, sizeof ( name ), "%s patch", fw_goldens[i].name );
+            status |= fw_test_report ( "image", name,
+                fw_golden_patch ( &fw_goldens[i], tools, fixtures, tmpdir ) );
+        }
+    }
+
+    status |= fw_test_report ( "image", "scan", fw_golden_scan ( tools, fixtures, tmpdir ) );
+
+    return status;
+}
@@ -0,0 +1,282 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Block Crc32 Index
+ * ------------------------------------------------------------------ */
+
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "fwtest.h"
+
+#define FW_INDEX_TEST_BLOCK (1 << 20)
+#define FW_INDEX_TEST_SIZE (64 << 20)
+#define FW_INDEX_TEST_OUTPUT 4096
+#define FW_INDEX_TEST_TRIES 20
+#define FW_INDEX_TEST_POLLS 100000
+
+/* Set file times to t seconds, results of files written just now are not trusted */
+static int fw_index_test_time ( const char *path, long t )
+{
+    struct timeval times[2];
+
+    memset ( times, '\0', sizeof ( times ) );
+    times[0].tv_sec = times[1].tv_sec = t;
+    return utimes ( path, times );
+}
+
+/* Write one byte at off of file, its mtime is set to t seconds */
+static int fw_index_test_write ( const char *path, size_t off, unsigned char byte, long t )
+{
+    int fd;
+
+    if ( ( fd = open ( path, O_WRONLY ) ) < 0 )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    if ( pwrite ( fd, &byte, 1, off ) != 1 )
+    {
+        perror ( path );
+        close ( fd );
+        return -1;
+    }
+    close ( fd );
+    return fw_index_test_time ( path, t );
+}
+
+/* Build trx image of noise stamped correct by trxcrc32, its mtime is set to t seconds */
+static int fw_index_test_image ( const char *tools, const char *path, long t )
+{
+    int status;
+    size_t off;
+    unsigned char *buf;
+    char out[FW_INDEX_TEST_OUTPUT];
+    FILE *file;
+
+    if ( !( buf = ( unsigned char * ) malloc ( FW_INDEX_TEST_BLOCK ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    if ( !( file = fopen ( path, "wb" ) ) )
+    {
+        perror ( path );
+        free ( buf );
+        return -1;
+    }
+
+    for ( off = 0; off < FW_INDEX_TEST_SIZE; off += FW_INDEX_TEST_BLOCK )
+    {
+        fw_fill ( buf, FW_INDEX_TEST_BLOCK, FW_TEST_SEED + off );
+        if ( !off )
+        {
+            fw_skeleton ( "trx", buf, FW_INDEX_TEST_SIZE );
+        }
+        fwrite ( buf, 1, FW_INDEX_TEST_BLOCK, file );
+    }
+
+    free ( buf );
+    if ( fclose ( file ) )
+    {
+        perror ( path );
+        return -1;
+    }
+
+    if ( fw_test_tool ( tools, "trxcrc32", "-u", path, out, sizeof ( out ), &status ) < 0
+        || status )
+    {
+        return -1;
+    }
+
+    return fw_index_test_time ( path, t );
+}
+
+/* Run trxcrc32 with index and stats, get bytes hashed, 0 if crc status is as wanted */
+static int fw_index_test_run ( const char *tools, const char *path, const char *want,
+    unsigned long long *hashed )
+{
+    int status;
+    unsigned long calls;
+    const char *stats;
+    char out[FW_INDEX_TEST_OUTPUT];
+
+    if ( fw_test_tool ( tools, "trxcrc32", "--index --stats", path, out, sizeof ( out ),
+            &status ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( status || !strstr ( out, want ) || !( stats = strstr ( out, "stats hash" ) )
+        || sscanf ( stats, "stats hash : %lu calls, %llu bytes", &calls, hashed ) != 2 )
+    {
+        fprintf ( stderr, "trxcrc32 --index: wanted %s:\n%s", want, out );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Check whether process still has file mapped */
+static int fw_index_test_mapped ( pid_t pid, const char *path )
+{
+    int found = FALSE;
+    char maps[64];
+    char line[8192];
+    FILE *file;
+
+    snprintf ( maps, sizeof ( maps ), "/proc/%d/maps", ( int ) pid );
+    if ( !( file = fopen ( maps, "r" ) ) )
+    {
+        return FALSE;
+    }
+
+    while ( !found && fgets ( line, sizeof ( line ), file ) )
+    {
+        found = strstr ( line, path ) != NULL;
+    }
+
+    fclose ( file );
+    return found;
+}
+
+/* Run trxcrc32 with index, write byte at off while it has the image open, 1 if caught */
+static int fw_index_test_race ( const char *tools, const char *path, size_t off )
+{
+    int caught = FALSE;
+    int ret;
+    unsigned int i;
+    pid_t pid;
+    char tool[4096];
+
+    snprintf ( tool, sizeof ( tool ), "%s/trxcrc32", tools );
+
+    if ( ( pid = fork (  ) ) < 0 )
+    {
+        perror ( "fork" );
+        return -1;
+    }
+
+    if ( !pid )
+    {
+        freopen ( "/dev/null", "w", stdout );
+        freopen ( "/dev/null", "w", stderr );
+        execl ( tool, "trxcrc32", "--index", "-a", "none", path, ( char * ) NULL );
+        _exit ( 127 );
+    }
+
+    /* pause it between mapping the image and writing the sidecar */
+    for ( i = 0; i < FW_INDEX_TEST_POLLS && !fw_index_test_mapped ( pid, path ); i++ )
+    {
+    }
+
+    if ( i < FW_INDEX_TEST_POLLS && !kill ( pid, SIGSTOP )
+        && waitpid ( pid, &ret, WUNTRACED ) == pid && WIFSTOPPED ( ret ) )
+    {
+        if ( ( caught = fw_index_test_mapped ( pid, path ) ) )
+        {
+            fw_index_test_write ( path, off, 0x5a, 1000000002 );
+        }
+        kill ( pid, SIGCONT );
+    }
+
+    if ( waitpid ( pid, &ret, 0 ) != pid || !WIFEXITED ( ret ) || WEXITSTATUS ( ret ) )
+    {
+        fprintf ( stderr, "Error: trxcrc32 --index failed\n" );
+        return -1;
+    }
+
+    return caught;
+}
+
+/* Check unchanged file is served from index and a changed one rebuilt */
+static int fw_index_test_reuse ( const char *tools, const char *path, int changed )
+{
+    unsigned long long hashed;
+
+    if ( changed && fw_index_test_write ( path, 5 * FW_INDEX_TEST_BLOCK + 7, 0xa5,
+            1000000003 ) < 0 )
+    {
+        return -1;
+    }
+
+    if ( fw_index_test_run ( tools, path, changed ? "crc status : incorrect"
+            : "crc status : correct", &hashed ) < 0 )
+    {
+        return -1;
+    }
+
+    /* only the block holding the header is hashed beyond the index */
+    if ( changed ? hashed < FW_INDEX_TEST_SIZE : hashed > FW_INDEX_TEST_BLOCK )
+    {
+        fprintf ( stderr, "trxcrc32 --index: %llu bytes hashed\n", hashed );
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Check index built while another process wrote the image is not trusted */
+static int fw_index_test_writer ( const char *tools, const char *path )
+{
+    int caught;
+    unsigned int i;
+    unsigned long long hashed;
+    char sidecar[4112];
+
+    snprintf ( sidecar, sizeof ( sidecar ), "%s.crcidx", path );
+
+    for ( i = 0; i < FW_INDEX_TEST_TRIES; i++ )
+    {
+        unlink ( sidecar );
+        if ( fw_index_test_image ( tools, path, 1000000000 ) < 0 )
+        {
+            return -1;
+        }
+
+        if ( ( caught = fw_index_test_race ( tools, path, 2000000 ) ) < 0 )
+        {
+            return -1;
+        }
+
+        /* the index has to see the byte written, as a plain run does */
+        if ( caught )
+        {
+            return fw_index_test_run ( tools, path, "crc status : incorrect", &hashed );
+        }
+    }
+
+    fprintf ( stderr, "Error: trxcrc32 could not be paused with the image open\n" );
+    return -1;
+}
+
+/* Check block index against unchanged and changed images, 0 if all passed */
+int fw_test_index ( const char *tools, const char *tmpdir )
+{
+    int status = 0;
+    unsigned long long hashed;
+    char path[4096];
+    char sidecar[4112];
+
+    snprintf ( path, sizeof ( path ), "%s/index.bin", tmpdir );
+    snprintf ( sidecar, sizeof ( sidecar ), "%s.crcidx", path );
+
+    /* the first run builds the index */
+    if ( fw_index_test_image ( tools, path, 1000000000 ) < 0
+        || fw_index_test_run ( tools, path, "crc status : correct", &hashed ) < 0 )
+    {
+        status = -1;
+    }
+
+    status |= fw_test_report ( "index", "unchanged", status < 0 ? -1
+        : fw_index_test_reuse ( tools, path, FALSE ) );
+    status |= fw_test_report ( "index", "dd write", status < 0 ? -1
+        : fw_index_test_reuse ( tools, path, TRUE ) );
+    status |= fw_test_report ( "index", "foreign write", fw_index_test_writer ( tools,
+            path ) );
+
+    unlink ( sidecar );
+    unlink ( path );
+    return status;
+}
@@ -0,0 +1,243 @@
+/* ------------------------------------------------------------------
+ * Firmware Utils Test Suite - Md5 Engines
+ * ------------------------------------------------------------------ */
+
+#include "fwtest.h"
+
+#define MD5_TEST_LEN 4096
+#define MD5_TEST_MSGS 24
+
+/* RFC 1321 test suite */
+static const struct
+{
+    const char *msg;
+    const char *digest;
+} md5_kat[] = {
+    {"", "d41d8cd98f00b204e9800998ecf8427e"},
+    {"a", "0cc175b9c0f1b6a831c399e269772661"},
+    {"abc", "900150983cd24fb0d6963f7d28e17f72"},
+    {"message digest", "f96b697d7cb7938d525a2f31aaf161d0"},
+    {"abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b"},
+    {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+        "d174ab98d277d9f5a5611c2c9f419d9f"},
+    {"12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+        "57edf4a22be3c955ac49da2e2107b67a"}
+};
+
+/* Md5 of 513 MiB of zeros */
+static const char md5_zeros[] = "f3a8799d64129a6fd8a5aa56f199ac54";
+
+/* Compare digest with its hex string */
+static int md5_test_match ( const unsigned char digest[16], const char *hex )
+{
+    unsigned int i;
+    char str[33];
+
+    for ( i = 0; i < 16; i++ )
+    {
+        snprintf ( str + 2 * i, 3, "%.2x", digest[i] );
+    }
+
+    return strcmp ( str, hex ) ? -1 : 0;
+}
+
+/* Digest of len bytes at data with engine, in one update or split in two */
+static void md5_test_digest ( const MD5_ENGINE * engine, unsigned char digest[16],
+    const unsigned char *data, size_t len, size_t split )
+{
+    MD5_CTX ctx;
+
+    MD5_Init ( &ctx );
+    MD5_Update_Engine ( engine, &ctx, data, split );
+    MD5_Update_Engine ( engine, &ctx, data + split, len - split );
+    MD5_Final_Engine ( engine, digest, &ctx );
+}
+
+/* Check one block function against the test suite and the reference */
+static int md5_test_engine ( const MD5_ENGINE * engine, const MD5_ENGINE * ref,
+    const unsigned char *buf )
+{
+    unsigned int i;
+    size_t align;
+    size_t len;
+    unsigned char digest[16];
+    unsigned char expect[16];
+
+    for ( i = 0; i < sizeof ( md5_kat ) / sizeof ( md5_kat[0] ); i++ )
+    {
+        len = strlen ( md5_kat[i].msg );
+        md5_test_digest ( engine, digest, ( const unsigned char * ) md5_kat[i].msg, len, len );
+        if ( md5_test_match ( digest, md5_kat[i].digest ) < 0 )
+        {
+            return -1;
+        }
+    }
+
+    /* every length at every alignment, in one and in two updates */
+    for ( align = 0; align < 16; align++ )
+    {
+        for ( len = 0; len <= MD5_TEST_LEN; len++ )
+        {
+            md5_test_digest ( ref, expect, buf + align, len, len );
+            md5_test_digest ( engine, digest, buf + align, len, len );
+            if ( memcmp ( digest, expect, 16 ) )
+            {
+                return -1;
+            }
+            md5_test_digest ( engine, digest, buf + align, len, len / 3 );
+            if ( memcmp ( digest, expect, 16 ) )
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Check the selected engine past the 32-bit bit counter */
+static int md5_test_large ( unsigned char *buf )
+{
+    unsigned int i;
+    MD5_CTX ctx;
+    unsigned char digest[16];
+
+    memset ( buf, '\0', 1 << 20 );
+    MD5_Init ( &ctx );
+    for ( i = 0; i < 513; i++ )
+    {
+        MD5_Update ( &ctx, buf, 1 << 20 );
+    }
+    MD5_Final ( digest, &ctx );
+
+    return md5_test_match ( digest, md5_zeros );
+}
+
+/* Check midstate at 2^32 bits, stored and resumed in a fresh context */
+static int md5_test_midstate ( unsigned char *buf )
+{
+    int status;
+    unsigned int i;
+    MD5_CTX ctx;
+    MD5_STATE state;
+    unsigned char digest[16];
+    unsigned char serialized[MD5_STATE_SIZE];
+
+    memset ( buf, '\0', 1 << 20 );
+    MD5_Init ( &ctx );
+    for ( i = 0; i < 512; i++ )
+    {
+        MD5_Update ( &ctx, buf, 1 << 20 );
+    }
+
+    status = MD5_Save ( &ctx, &state );
+    MD5_Serialize ( &state, serialized );
+    memset ( &state, '\0', sizeof ( state ) );
+    MD5_Deserialize ( &state, serialized );
+    MD5_Init ( &ctx );
+    MD5_Restore ( &ctx, &state );
+    MD5_Update ( &ctx, buf, 1 << 20 );
+    MD5_Final ( digest, &ctx );
+
+    if ( md5_test_match ( digest, md5_zeros ) < 0
+        || memcmp ( serialized, "\0\0\0\0\1\0\0\0", 8 ) )
+    {
+        return -1;
+    }
+
+    return status;
+}
+
+/* Check one lane kernel against scalar md5, on batches of messages of
+   pseudo-random length, alignment and context fill */
+static int md5_test_multi ( const MD5_MULTI_ENGINE * engine, const unsigned char *buf )
+{
+    unsigned int i;
+    unsigned int round;
+    uint64_t x = FW_TEST_SEED;
+    size_t head[MD5_TEST_MSGS];
+    size_t len[MD5_TEST_MSGS];
+    size_t off;
+    const void *data[MD5_TEST_MSGS];
+    unsigned char digest[16];
+    unsigned char expect[16];
+    MD5_CTX ctx[MD5_TEST_MSGS];
+    MD5_CTX *ctxs[MD5_TEST_MSGS];
+    MD5_CTX single;
+
+    for ( round = 0; round < 64; round++ )
+    {
+        /* some contexts start mid-block, some messages are empty */
+        for ( i = 0, off = 0; i < MD5_TEST_MSGS; i++ )
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            head[i] = ( x >> 8 ) % 4 ? 0 : ( x >> 16 ) % 64;
+            len[i] = ( x >> 24 ) % 8 ? ( x >> 32 ) % ( MD5_TEST_LEN + 1 ) : 0;
+            off += ( x >> 48 ) % 16;
+            data[i] = buf + off + head[i];
+            off += head[i] + len[i];
+
+            MD5_Init ( &ctx[i] );
+            MD5_Update ( &ctx[i], buf + off - head[i] - len[i], head[i] );
+            ctxs[i] = &ctx[i];
+        }
+
+        MD5_Update_Multi_Engine ( engine, ctxs, data, len, MD5_TEST_MSGS );
+
+        for ( i = 0; i < MD5_TEST_MSGS; i++ )
+        {
+            MD5_Final ( digest, &ctx[i] );
+            MD5_Init ( &single );
+            MD5_Update ( &single, ( const unsigned char * ) data[i] - head[i],
+                head[i] + len[i] );
+            MD5_Final ( expect, &single );
+            if ( memcmp ( digest, expect, 16 ) )
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Check every md5 block function and lane kernel, 0 if all passed */
+int fw_test_md5 ( void )
+{
+    int status = 0;
+    unsigned int i;
+    unsigned int count;
+    unsigned char *buf;
+    const MD5_ENGINE *engines;
+    MD5_MULTI_ENGINE kernels[MD5_MULTI_ENGINES];
+
+    if ( !( buf = ( unsigned char * ) malloc ( 1 << 20 ) ) )
+    {
+        fprintf ( stderr, "Error: out of memory\n" );
+        return -1;
+    }
+
+    fw_fill ( buf, 1 << 20, FW_TEST_SEED );
+
+    /* the reference Transform comes last */
+    count = MD5_Engines ( &engines );
+    for ( i = 0; i < count; i++ )
+    {
+        status |= fw_test_report ( "md5", engines[i].name,
+            md5_test_engine ( &engines[i], &engines[count - 1], buf ) );
+    }
+
+    count = MD5_Multi_Engines ( kernels );
+    for ( i = 0; i < count; i++ )
+    {
+        status |= fw_test_report ( "md5mb", kernels[i].name, md5_test_multi ( &kernels[i], buf ) );
+    }
+
+    status |= fw_test_report ( "md5", "513 MiB stream", md5_test_large ( buf ) );
+    status |= fw_test_report ( "md5", "midstate", md5_test_midstate ( buf ) );
+
+    free ( buf );
+    return status;
+}